@@ -0,0 +1,71 @@
+// vectorized sums over aligned and unaligned buffers
+
+/**
+ *  Sums arrays of ints created by make_unique_aligned, once with the
+ *  compiler told the data is aligned to 64 bytes, so that it uses aligned
+ *  vector loads without a scalar prologue, once without, and once over a
+ *  buffer shifted by one int, whose vector loads straddle cache lines. The
+ *  arrays either fit in L1 or spill to memory. Built with -O3 -march=native
+ *  so that the loops use the widest vectors of the machine.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+
+__attribute__((noinline)) int
+sum_aligned(const int* p, std::size_t n)
+{
+    const int* a = static_cast<const int*>(__builtin_assume_aligned(p, 64));
+    int s = 0;
+    for (std::size_t i = 0; i < n; ++i) s += a[i];
+    return s;
+}
+
+__attribute__((noinline)) int
+sum_any(const int* p, std::size_t n)
+{
+    int s = 0;
+    for (std::size_t i = 0; i < n; ++i) s += p[i];
+    return s;
+}
+
+/// Hides p from the optimizer, so that each round sums again
+inline const int*
+opaque(const int* p)
+{
+    asm volatile("" : "+r"(p));
+    return p;
+}
+
+template<typename F>
+void time(const char* name, std::size_t n, std::size_t rounds, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (std::size_t r = 0; r < rounds; ++r) sum += f();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-30s %9zu ints %8.3f ns/int   (%ld)\n", name, n,
+                secs.count() * 1e9 / (n * rounds), sum);
+}
+
+int main()
+{
+    for (std::size_t n : {std::size_t{4096}, std::size_t{1} << 24}) {
+        const std::size_t rounds = (std::size_t{1} << 30) / n;
+        // one more int, so that the shifted view has n of them too
+        auto buf = smart_ptr::make_unique_aligned<int[]>(n + 1, 64);
+        for (std::size_t i = 0; i <= n; ++i) buf[i] = static_cast<int>(i & 0xff);
+        const int* aligned = buf.get();
+        const int* shifted = buf.get() + 1;
+
+        time("aligned, assumed aligned", n, rounds,
+             [&] { return sum_aligned(opaque(aligned), n); });
+        time("aligned", n, rounds,
+             [&] { return sum_any(opaque(aligned), n); });
+        time("shifted by one int", n, rounds,
+             [&] { return sum_any(opaque(shifted), n); });
+    }
+}
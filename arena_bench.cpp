@@ -0,0 +1,97 @@
+// random copies of shared_ptrs to heap and huge page arena objects
+
+/**
+ *  Creates 50M shared_ptrs, once with make_shared from the general heap
+ *  and once with allocate_shared from a huge_page_arena, then copies and
+ *  destroys random ones: each copy increments and each destruction
+ *  decrements the count of a random control block, which in the heap case
+ *  sits on one of hundreds of thousands of 4 KB pages, mostly missing the
+ *  TLB. The shared_ptrs themselves are kept in a huge page array in both
+ *  cases, so that only the control blocks differ. The count may be given
+ *  as the first argument.
+ *
+ *  Last, several threads create and drop batches of shared_ptrs at once,
+ *  with make_shared and with make_shared_arena, whose global arena they
+ *  all share; its thread caches keep them off its lock. The number of
+ *  threads may be given as the second argument.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <random>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+
+struct Node {
+    long value;
+};
+
+template<typename Make>
+void run(const char* name, std::size_t n, const std::vector<std::size_t>& order, Make make)
+{
+    auto live = smart_ptr::make_unique_huge<shared_ptr<Node>[]>(n);
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < n; ++i) live[i] = make(static_cast<long>(i));
+    std::chrono::duration<double> create = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    long sum = 0;
+    for (auto i : order) {
+        shared_ptr<Node> copy = live[i];
+        sum += copy->value;
+    }
+    std::chrono::duration<double> copies = std::chrono::steady_clock::now() - start;
+
+    std::printf("%-16s create %7.2f ns/object   copy + destroy %7.2f ns/op   (%ld)\n",
+                name, create.count() * 1e9 / n, copies.count() * 1e9 / order.size(), sum);
+}
+
+template<typename Make>
+void contend(const char* name, unsigned threads, Make make)
+{
+    const std::size_t rounds = 2000, batch = 1000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> ts;
+    for (unsigned t = 0; t < threads; ++t)
+        ts.emplace_back([&] {
+            std::vector<shared_ptr<Node>> v;
+            v.reserve(batch);
+            for (std::size_t r = 0; r < rounds; ++r) {
+                for (std::size_t i = 0; i < batch; ++i) v.push_back(make(static_cast<long>(i)));
+                v.clear();
+            }
+        });
+    for (auto& t : ts) t.join();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-16s %u threads   create + destroy %7.2f ns/object\n", name, threads,
+                secs.count() * 1e9 / (rounds * batch * threads));
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50000000;
+    const unsigned threads = argc > 2 ? std::atoi(argv[2]) : 4;
+    const std::size_t ops = 20000000;
+
+    std::vector<std::size_t> order(ops);
+    std::mt19937_64 gen{42};
+    std::uniform_int_distribution<std::size_t> dist{0, n - 1};
+    for (auto& i : order) i = dist(gen);
+
+    run("heap", n, order, [](long v) { return smart_ptr::make_shared<Node>(Node{v}); });
+
+    smart_ptr::huge_page_arena arena;
+    run("huge page arena", n, order, [&](long v) {
+        return smart_ptr::allocate_shared<Node>(smart_ptr::arena_allocator<Node>{arena}, Node{v});
+    });
+    std::printf("arena regions: %zu\n", arena.region_count());
+
+    contend("heap", threads, [](long v) { return smart_ptr::make_shared<Node>(Node{v}); });
+    contend("global arena", threads, [](long v) { return smart_ptr::make_shared_arena<Node>(Node{v}); });
+}
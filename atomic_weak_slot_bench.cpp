@@ -0,0 +1,82 @@
+// contention on an atomic_weak_slot and on a weak_ptr behind a mutex
+
+/**
+ *  Reader threads lock the weak_ptr of a single cache slot in a loop while
+ *  one writer thread replaces it now and then. Compares atomic_weak_slot
+ *  with a weak_ptr guarded by a mutex, for a growing number of readers.
+ */
+
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::atomic_weak_slot;
+
+/// weak_ptr slot protected by a mutex, the baseline
+class MutexSlot {
+public:
+    void store(const shared_ptr<int>& sp)
+    {
+        std::lock_guard<std::mutex> lk{mutex};
+        wp = sp;
+    }
+
+    shared_ptr<int> try_lock()
+    {
+        std::lock_guard<std::mutex> lk{mutex};
+        return wp.lock();
+    }
+
+private:
+    std::mutex mutex;
+    weak_ptr<int> wp;
+};
+
+template<typename Slot>
+void run(const char* name, int readers)
+{
+    Slot slot;
+    std::vector<shared_ptr<int>> values;
+    for (int i = 0; i < 16; ++i) values.push_back(smart_ptr::make_shared<int>(i));
+    slot.store(values[0]);
+
+    std::atomic<bool> stop{false};
+    std::atomic<long> total{0};
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&] {
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed))
+                if (slot.try_lock()) ++n;
+            total += n;
+        });
+    }
+    threads.emplace_back([&] {
+        for (int i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+            slot.store(values[i % values.size()]);
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+
+    const double secs = 0.5;
+    std::this_thread::sleep_for(std::chrono::duration<double>(secs));
+    stop = true;
+    for (auto& t : threads) t.join();
+    std::printf("%-20s %2d readers %8.2f M locks/s\n", name, readers, total / secs / 1e6);
+}
+
+int main()
+{
+    int max_readers = static_cast<int>(std::thread::hardware_concurrency());
+    if (max_readers < 4) max_readers = 4;
+    for (int readers = 1; readers <= max_readers; readers *= 2) {
+        run<MutexSlot>("mutex weak_ptr", readers);
+        run<atomic_weak_slot<int>>("atomic_weak_slot", readers);
+    }
+}
@@ -0,0 +1,120 @@
+// demo of atomic_weak_slot
+
+/**
+ *  Checks the single-threaded contract of atomic_weak_slot, then has
+ *  writers keep storing, resetting and compare-exchanging new objects into
+ *  one slot while readers keep locking and loading it: every object a
+ *  reader gets must be alive and intact, and every object and slot node
+ *  must be freed once all is done. Build with -fsanitize=address or
+ *  -fsanitize=thread to check the latter more closely.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::atomic_weak_slot;
+
+struct Value {
+    explicit Value(long v) : value{v}, check{~v} { ++live; }
+    ~Value() { check = value; --live; }
+
+    bool intact() const { return check == ~value; }
+
+    long value;
+    long check;
+
+    static std::atomic<long> live;
+};
+
+std::atomic<long> Value::live{0};
+
+int main()
+{
+    std::cout << "===============atomic_weak_slot demo===============" << std::endl;
+
+    std::cout << "\nSlot contract demo\n";
+    {
+        atomic_weak_slot<Value> slot;
+        assert(slot.expired() && !slot.try_lock());
+
+        auto a = make_shared<Value>(1);
+        slot.store(a);
+        auto locked = slot.try_lock();
+        assert(locked == a && a.use_count() == 2);
+        locked.reset();
+
+        weak_ptr<Value> expected = slot.load();
+        auto b = make_shared<Value>(2);
+        const bool swapped = slot.compare_exchange(expected, b);
+        assert(swapped && slot.try_lock() == b);
+        const bool swapped_again = slot.compare_exchange(expected, a); // expected is a
+        assert(!swapped_again && expected.lock() == b);
+
+        b.reset();
+        assert(slot.expired() && !slot.try_lock()); // the slot does not own b
+        slot.reset();
+        std::cout << "lock-free: " << slot.is_lock_free() << '\n';
+    }
+    assert(Value::live == 0);
+
+    std::cout << "\nConcurrent store and try_lock demo\n";
+    {
+        const int writers = 2, readers = 4, rounds = 20000;
+        atomic_weak_slot<Value> slot;
+        std::atomic<bool> done{false};
+        std::atomic<long> hits{0}, misses{0};
+        std::vector<std::thread> ts;
+
+        for (int w = 0; w < writers; ++w)
+            ts.emplace_back([&] {
+                shared_ptr<Value> held; // keeps the last object stored alive
+                for (long r = 0; r < rounds; ++r) {
+                    auto sp = make_shared<Value>(r);
+                    switch (r % 8) {
+                    case 0:
+                        slot.reset();
+                        break;
+                    case 1: {
+                        weak_ptr<Value> expected = slot.load();
+                        slot.compare_exchange(expected, sp);
+                        break;
+                    }
+                    default:
+                        slot.store(sp);
+                    }
+                    held = std::move(sp); // the previous one expires
+                }
+            });
+        for (int r = 0; r < readers; ++r)
+            ts.emplace_back([&] {
+                long h = 0, m = 0;
+                while (!done.load(std::memory_order_relaxed)) {
+                    if (auto sp = slot.try_lock()) {
+                        assert(sp->intact());
+                        ++h;
+                    } else {
+                        ++m;
+                    }
+                    if (auto sp = slot.load().lock()) assert(sp->intact());
+                }
+                hits += h;
+                misses += m;
+            });
+
+        for (int w = 0; w < writers; ++w) ts[w].join();
+        done = true;
+        for (std::size_t t = writers; t < ts.size(); ++t) ts[t].join();
+        std::cout << "locked: " << hits << ", expired or empty: " << misses << '\n';
+    }
+    assert(Value::live == 0);
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+// false sharing between reference counts and a written object
+
+/**
+ *  Writers keep storing to a small object while readers keep copying and
+ *  dropping shared_ptrs to it, for one second, once with the object from
+ *  make_shared, its counts on the same cache line, and once from
+ *  make_shared_isolated, the counts on a line of their own. The numbers of
+ *  writes and copies done are reported. The numbers of writer and reader
+ *  threads may be given as the first and second arguments; false sharing
+ *  only shows when they run on different cores.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+
+struct Counter {
+    std::atomic<long> value{0};
+};
+
+void run(const char* name, const shared_ptr<Counter>& sp,
+         unsigned writers, unsigned readers)
+{
+    std::atomic<bool> stop{false};
+    std::atomic<long> writes{0}, copies{0};
+    std::vector<std::thread> threads;
+
+    for (unsigned w = 0; w < writers; ++w)
+        threads.emplace_back([&] {
+            Counter* c = sp.get();
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                c->value.store(c->value.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                ++n;
+            }
+            writes += n;
+        });
+    for (unsigned r = 0; r < readers; ++r)
+        threads.emplace_back([&] {
+            long n = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                shared_ptr<Counter> copy = sp;
+                ++n;
+            }
+            copies += n;
+        });
+
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    stop = true;
+    for (auto& t : threads) t.join();
+
+    std::printf("%-22s %12.2f M writes/s %12.2f M copies/s\n", name,
+                writes.load() / 1e6, copies.load() / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    const unsigned writers = argc > 1 ? std::atoi(argv[1]) : 1;
+    const unsigned readers = argc > 2 ? std::atoi(argv[2]) : 3;
+    std::printf("%u writers, %u readers, %u hardware threads\n", writers, readers,
+                std::thread::hardware_concurrency());
+
+    run("make_shared", smart_ptr::make_shared<Counter>(), writers, readers);
+    run("make_shared_isolated", smart_ptr::make_shared_isolated<Counter>(), writers, readers);
+}
@@ -0,0 +1,86 @@
+// startup and random access of huge page arrays against new[]
+
+/**
+ *  Times creating a 512 MB array with make_unique_huge, lazily and
+ *  populated, and with new[], default- and value-initialized, then the
+ *  latency of random dependent loads through each: the array holds a
+ *  single random cycle, so every load needs the previous one, and on a
+ *  table this large most of them miss the TLB with 4 KB pages. The size in
+ *  MB may be given as the first argument.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+/// Keeps the compiler from eliding the array p points to
+inline void
+escape(const void* p)
+{ asm volatile("" : : "r"(p) : "memory"); }
+
+template<typename F>
+void startup(const char* name, F f)
+{
+    auto start = Clock::now();
+    f();
+    std::chrono::duration<double> secs = Clock::now() - start;
+    std::printf("create %-30s %10.3f ms\n", name, secs.count() * 1e3);
+}
+
+/// Follows the cycle for steps loads, returns the ns per load
+double
+chase(const std::uint64_t* a, std::size_t steps)
+{
+    auto start = Clock::now();
+    std::uint64_t i = 0;
+    for (std::size_t s = 0; s < steps; ++s) i = a[i];
+    std::chrono::duration<double> secs = Clock::now() - start;
+    if (i == ~std::uint64_t{0}) std::puts("");
+    return secs.count() * 1e9 / steps;
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t mb = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 512;
+    const std::size_t n = (mb << 20) / sizeof(std::uint64_t), steps = 20000000;
+
+    // creation alone, each array released right away
+    startup("make_unique_huge", [&] {
+        auto a = smart_ptr::make_unique_huge<std::uint64_t[]>(n);
+        escape(a.get());
+    });
+    startup("make_unique_huge, populated", [&] {
+        auto a = smart_ptr::make_unique_huge<std::uint64_t[]>(n, true);
+        escape(a.get());
+    });
+    startup("new[]", [&] {
+        smart_ptr::unique_ptr<std::uint64_t[]> a{new std::uint64_t[n]};
+        escape(a.get());
+    });
+    startup("new[]()", [&] {
+        smart_ptr::unique_ptr<std::uint64_t[]> a{new std::uint64_t[n]()};
+        escape(a.get());
+    });
+
+    // a single random cycle through all elements (Sattolo's algorithm)
+    auto huge = smart_ptr::make_unique_huge<std::uint64_t[]>(n, true);
+    for (std::size_t i = 0; i < n; ++i) huge[i] = i;
+    std::mt19937_64 gen{42};
+    for (std::size_t i = n - 1; i > 0; --i) {
+        std::uniform_int_distribution<std::size_t> dist{0, i - 1};
+        std::swap(huge[i], huge[dist(gen)]);
+    }
+    smart_ptr::unique_ptr<std::uint64_t[]> plain{new std::uint64_t[n]};
+    std::memcpy(plain.get(), huge.get(), n * sizeof(std::uint64_t));
+
+    std::printf("random load  %-26s %10.2f ns\n", "make_unique_huge", chase(huge.get(), steps));
+    std::printf("random load  %-26s %10.2f ns\n", "new[]", chase(plain.get(), steps));
+}
@@ -0,0 +1,128 @@
+// aligned array allocation
+
+/**
+ * make_unique_aligned<T[]>(n, align) and make_shared_aligned<T[]>(n, align)
+ *  create an array of n value-initialized elements whose first element is
+ *  aligned to align bytes, e.g. 64 for AVX-512 loads or 4096 for a page.
+ *  The array is freed by aligned_delete, which remembers the element count
+ *  and the alignment so that it can hand both back to the allocator.
+ */
+
+#ifndef ALIGNED_HPP
+#define ALIGNED_HPP 1
+
+#include <cstddef>      // size_t
+#include <new>          // placement new, bad_array_new_length
+#include <limits>       // numeric_limits
+#include <stdexcept>    // invalid_argument
+#include <type_traits>  // remove_extent, enable_if, is_array, extent
+
+#include "allocate.hpp"
+#include "unique_ptr.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+// aligned_delete, deleter for arrays created by the aligned factories
+
+template<typename T> class aligned_delete;
+
+template<typename T>
+class aligned_delete<T[]>
+{
+public:
+    /// Default constructor, for a unique_ptr that owns nothing
+    constexpr aligned_delete() noexcept
+    : _n{0},
+      _align{alignof(T)}
+    { }
+
+    /// Constructs the deleter of n elements aligned to align
+    aligned_delete(std::size_t n, std::size_t align) noexcept
+    : _n{n},
+      _align{align}
+    { }
+
+    /// Call operator, destroys the elements and frees the array
+    void operator()(T* p) const
+    {
+        for (std::size_t _i = _n; _i > 0; --_i)
+            p[_i - 1].~T();
+        detail::deallocate(static_cast<void*>(p), _n * sizeof(T), _align);
+    }
+
+    /// Number of elements of the array
+    std::size_t
+    size() const noexcept
+    { return _n; }
+
+    /// Alignment of the array
+    std::size_t
+    alignment() const noexcept
+    { return _align; }
+
+private:
+    std::size_t _n;
+    std::size_t _align;
+};
+
+namespace detail {
+
+/// Allocates n value-initialized elements aligned to at least align
+template<typename T>
+    T*
+    make_aligned_array(std::size_t n, std::size_t& align)
+    {
+        if (align == 0 || (align & (align - 1)) != 0)
+            throw std::invalid_argument{"alignment must be a power of two"};
+        if (align < alignof(T)) align = alignof(T);
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length{};
+        T* _p = static_cast<T*>(allocate(n * sizeof(T), align));
+        std::size_t _i = 0;
+        try {
+            for (; _i < n; ++_i)
+                ::new (static_cast<void*>(_p + _i)) T();
+        } catch (...) {
+            for (; _i > 0; --_i)
+                _p[_i - 1].~T();
+            deallocate(static_cast<void*>(_p), n * sizeof(T), align);
+            throw;
+        }
+        return _p;
+    }
+
+} // namespace detail
+
+/// Creates a unique_ptr that manages a new array of n elements
+///     aligned to align, a power of two. Only for arrays with unknown bound.
+template<typename T>
+    inline typename std::enable_if<std::is_array<T>::value && !std::extent<T>::value,
+        unique_ptr<T, aligned_delete<T>>>::type
+    make_unique_aligned(std::size_t n, std::size_t align)
+    {
+        using U = typename std::remove_extent<T>::type;
+        U* _p = detail::make_aligned_array<U>(n, align);
+        return unique_ptr<T, aligned_delete<T>>{_p, aligned_delete<T>{n, align}};
+    }
+
+/// Creates a shared_ptr that manages a new array of n elements
+///     aligned to align, a power of two. Only for arrays with unknown bound.
+template<typename T>
+    inline typename std::enable_if<std::is_array<T>::value && !std::extent<T>::value,
+        shared_ptr<T>>::type
+    make_shared_aligned(std::size_t n, std::size_t align)
+    {
+        using U = typename std::remove_extent<T>::type;
+        U* _p = detail::make_aligned_array<U>(n, align);
+        try {
+            return shared_ptr<T>{_p, aligned_delete<T>{n, align}};
+        } catch (...) {
+            aligned_delete<T>{n, align}(_p);
+            throw;
+        }
+    }
+
+} // namespace smart_ptr
+
+#endif
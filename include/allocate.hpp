@@ -0,0 +1,176 @@
+// raw memory allocation helpers
+
+/**
+ * allocate and deallocate wrap the global operator new and operator delete.
+ *  deallocate is told the size and the alignment of the block being freed,
+ *  and forwards them to the sized (C++14) and aligned (C++17) forms of
+ *  operator delete when the compiler supports them, so that allocators such
+ *  as jemalloc or tcmalloc do not have to look the size up.
+ *
+ * Sized frees need __cpp_sized_deallocation, which g++ and clang define
+ *  from -std=c++14 on, or with -fsized-deallocation. Under plain C++11,
+ *  as the demos are built, every free is unsized and the allocator looks
+ *  the size up itself; see sized_delete_bench.cpp for what that costs.
+ *
+ * Over-aligned requests are honoured before C++17 as well, by
+ *  over-allocating. new_object and delete_object use this for single
+ *  objects that new T would not align. Such an object cannot be freed with
+ *  delete, so only make_shared, which keeps the matching object_delete in
+ *  the control block, creates them this way; default_delete always calls
+ *  delete, and make_unique always uses new T.
+ */
+
+#ifndef ALLOCATE_HPP
+#define ALLOCATE_HPP 1
+
+#include <cstddef>      // size_t, max_align_t
+#include <cstdint>      // uintptr_t
+#include <new>          // operator new, operator delete, align_val_t
+#include <utility>      // forward
+#include <type_traits>  // integral_constant, remove_cv
+
+namespace smart_ptr {
+
+namespace detail {
+
+/// Alignment guaranteed by plain operator new
+constexpr std::size_t default_new_alignment =
+#ifdef __STDCPP_DEFAULT_NEW_ALIGNMENT__
+    __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#else
+    alignof(std::max_align_t);
+#endif
+
+#ifndef __cpp_aligned_new
+
+// Without aligned operator new, over-aligned blocks are carved out of a
+//  larger one, with the address of the latter stored right before them
+
+/// Size of the block allocated for size bytes aligned to align
+constexpr std::size_t
+overaligned_size(std::size_t size, std::size_t align) noexcept
+{ return size + align + sizeof(void*); }
+
+#endif
+
+/// Allocates size bytes aligned to align, a power of two
+inline void*
+allocate(std::size_t size, std::size_t align = default_new_alignment)
+{
+    if (align > default_new_alignment) {
+#ifdef __cpp_aligned_new
+        return ::operator new(size, static_cast<std::align_val_t>(align));
+#else
+        void* _raw = ::operator new(overaligned_size(size, align));
+        auto _addr = (reinterpret_cast<std::uintptr_t>(_raw) + sizeof(void*)
+                      + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+        reinterpret_cast<void**>(_addr)[-1] = _raw;
+        return reinterpret_cast<void*>(_addr);
+#endif
+    }
+    return ::operator new(size);
+}
+
+/// Frees p, obtained from allocate(size, align)
+inline void
+deallocate(void* p, std::size_t size,
+           std::size_t align = default_new_alignment) noexcept
+{
+    if (align > default_new_alignment) {
+#if defined(__cpp_aligned_new) && defined(__cpp_sized_deallocation)
+        ::operator delete(p, size, static_cast<std::align_val_t>(align));
+#elif defined(__cpp_aligned_new)
+        ::operator delete(p, static_cast<std::align_val_t>(align));
+#elif defined(__cpp_sized_deallocation)
+        ::operator delete(static_cast<void**>(p)[-1], overaligned_size(size, align));
+#else
+        ::operator delete(static_cast<void**>(p)[-1]);
+#endif
+        return;
+    }
+#ifdef __cpp_sized_deallocation
+    ::operator delete(p, size);
+#else
+    (void)size;
+    ::operator delete(p);
+#endif
+}
+
+/// Whether new T misaligns T: before C++17, T is over-aligned and has no
+///     class-specific operator new to align it
+template<typename T, typename = void>
+struct overaligned_new
+    : std::integral_constant<bool,
+#ifdef __cpp_aligned_new
+        false
+#else
+        (alignof(T) > default_new_alignment)
+#endif
+        > { };
+
+template<typename T>
+struct overaligned_new<T,
+    decltype(void(std::remove_cv<T>::type::operator new(std::size_t{})))>
+    : std::false_type { };
+
+template<typename T, typename... Args>
+    inline T*
+    new_object(std::false_type, Args&&... args)
+    { return new T{std::forward<Args>(args)...}; }
+
+template<typename T, typename... Args>
+    inline T*
+    new_object(std::true_type, Args&&... args)
+    {
+        void* _p = allocate(sizeof(T), alignof(T));
+        try {
+            return ::new (_p) T{std::forward<Args>(args)...};
+        } catch (...) {
+            deallocate(_p, sizeof(T), alignof(T));
+            throw;
+        }
+    }
+
+/// Creates a T from args, with new T unless it would misalign T
+template<typename T, typename... Args>
+    inline T*
+    new_object(Args&&... args)
+    {
+        return new_object<T>(std::integral_constant<bool, overaligned_new<T>::value>{},
+                             std::forward<Args>(args)...);
+    }
+
+template<typename T>
+    inline void
+    delete_object(T* p, std::false_type)
+    { delete p; }
+
+template<typename T>
+    inline void
+    delete_object(T* p, std::true_type)
+    {
+        p->~T();
+        deallocate(const_cast<void*>(static_cast<const volatile void*>(p)),
+                   sizeof(T), alignof(T));
+    }
+
+/// Destroys and frees *p, created by new_object<T>
+template<typename T>
+    inline void
+    delete_object(T* p)
+    { delete_object(p, std::integral_constant<bool, overaligned_new<T>::value>{}); }
+
+/// Deleter of objects created by new_object<T>, which it must be given as
+///     a T*, not as a pointer to a base
+template<typename T>
+struct object_delete {
+    void
+    operator()(T* p) const noexcept
+    { delete_object(p); }
+};
+
+} // namespace detail
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,407 @@
+// huge page arena for control blocks and small shared objects
+
+/**
+ * Control blocks allocated from the general heap end up scattered over
+ *  many pages, so a workload copying random shared_ptrs takes a TLB miss on
+ *  nearly every reference count update. huge_page_arena packs small blocks
+ *  densely into 2 MiB huge page regions instead, carved into size classes
+ *  with a free list each, so that all live control blocks sit in a handful
+ *  of TLB entries.
+ *
+ * The shared free lists are guarded by one mutex per arena, which every
+ *  thread using make_shared_arena would contend on. So each thread also
+ *  keeps a cache of up to thread_cache_size free blocks per size class,
+ *  which serves its allocations and takes its frees without a lock, and
+ *  moves half a cache at a time to or from the shared lists when it runs
+ *  empty or full. A block freed by another thread than the one allocating
+ *  it goes to the freeing thread's cache. See arena_bench.cpp for the
+ *  contended case.
+ *
+ * arena_allocator plugs an arena into allocate_shared, which places the
+ *  control block and the object in one block from the arena:
+ *
+ *      auto sp = make_shared_arena<Node>(args...);    // global arena
+ *      auto sp = allocate_shared<Node>(arena_allocator<Node>{arena}, args...);
+ *
+ * Blocks larger than max_block_size, or more aligned than block_alignment,
+ *  are passed through to operator new. An arena must outlive every block
+ *  allocated from it; regions are only returned to the system when the
+ *  arena is destroyed. The global arena never is. Blocks cached by a thread
+ *  when the arena is destroyed are dropped by that thread on its next use
+ *  of an arena, or on its exit.
+ *
+ * An arena may be given a hook that is called on every memory range it maps,
+ *  before the range is touched, e.g. to set its NUMA policy. Large blocks of
+ *  such an arena are then mapped on their own instead of passed through, so
+ *  that the hook applies to them as well. This costs an mmap, a hook call
+ *  and at least a whole page per large block, and a munmap per free: an
+ *  arena with a hook suits workloads whose blocks are nearly all small.
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP 1
+
+#include <cstddef>      // size_t
+#include <atomic>       // atomic
+#include <mutex>        // mutex, lock_guard
+#include <vector>       // vector
+#include <utility>      // forward, move, swap
+#include <functional>   // function
+
+#include "allocate.hpp"
+#include "huge_page.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+// Class huge_page_arena
+
+class huge_page_arena {
+public:
+    /// Size classes are multiples of block_alignment up to max_block_size
+    static constexpr std::size_t block_alignment = 16;
+    static constexpr std::size_t max_block_size = 512;
+
+    /// Maximum number of free blocks of each size class cached by each thread
+    static constexpr std::size_t thread_cache_size = 64;
+
+    /// Hook called on each range mapped, with its address and length
+    using map_hook = std::function<void(void*, std::size_t)>;
+
+    huge_page_arena()
+    : huge_page_arena{map_hook{}}
+    { }
+
+    /// Constructs an arena calling on_map on each range it maps
+    explicit huge_page_arena(map_hook on_map)
+    : _state{smart_ptr::make_shared<_State>(std::move(on_map))}
+    { }
+
+    huge_page_arena(const huge_page_arena&) = delete;
+    huge_page_arena& operator=(const huge_page_arena&) = delete;
+
+    /// Returns all regions to the system; blocks cached by threads are
+    ///     dropped by those threads
+    ~huge_page_arena()
+    {
+        std::lock_guard<std::mutex> _lk{_state->mutex};
+        _state->closed.store(true, std::memory_order_relaxed);
+        for (auto _r : _state->regions)
+            detail::huge_page_unmap(_r, huge_page_size);
+        _state->regions.clear();
+    }
+
+    /// Allocates size bytes aligned to align
+    void*
+    allocate(std::size_t size, std::size_t align)
+    {
+        if (size > max_block_size || align > block_alignment) {
+            if (!_state->on_map) return detail::allocate(size, align);
+            const std::size_t _bytes = _page_round(size);
+            void* _p = detail::huge_page_map(_bytes, false);
+            _state->on_map(_p, _bytes);
+            return _p;
+        }
+
+        const std::size_t _c = _class(size);
+        if (auto _cache = _local()) {
+            auto& _l = _cache->lists;
+            if (!_l.head[_c]) {
+                // Takes half a cache at once, to go back to the lock rarely
+                std::lock_guard<std::mutex> _lk{_state->mutex};
+                for (std::size_t _i = 0; _i < thread_cache_size / 2; ++_i)
+                    _l.push(_c, _state->take(_c));
+            }
+            return _l.pop(_c);
+        }
+        std::lock_guard<std::mutex> _lk{_state->mutex};
+        return _state->take(_c);
+    }
+
+    /// Frees p, obtained from allocate(size, align)
+    void
+    deallocate(void* p, std::size_t size, std::size_t align) noexcept
+    {
+        if (size > max_block_size || align > block_alignment) {
+            if (!_state->on_map) detail::deallocate(p, size, align);
+            else detail::huge_page_unmap(p, _page_round(size));
+            return;
+        }
+
+        const std::size_t _c = _class(size);
+        auto _b = static_cast<_Block*>(p);
+        if (auto _cache = _local()) {
+            auto& _l = _cache->lists;
+            if (_l.n[_c] == thread_cache_size) {
+                std::lock_guard<std::mutex> _lk{_state->mutex};
+                for (std::size_t _i = 0; _i < thread_cache_size / 2; ++_i)
+                    _state->put(_c, _l.pop(_c));
+            }
+            _l.push(_c, _b);
+            return;
+        }
+        std::lock_guard<std::mutex> _lk{_state->mutex};
+        _state->put(_c, _b);
+    }
+
+    /// Number of huge page regions mapped so far
+    std::size_t
+    region_count() const
+    {
+        std::lock_guard<std::mutex> _lk{_state->mutex};
+        return _state->regions.size();
+    }
+
+    /// The arena used by make_shared_arena, which is never destroyed
+    static huge_page_arena&
+    global()
+    {
+        static huge_page_arena* _arena = new huge_page_arena;
+        return *_arena;
+    }
+
+private:
+    struct _Block { _Block* next; };
+
+    static constexpr std::size_t _class_count = max_block_size / block_alignment;
+
+    static std::size_t
+    _class(std::size_t size) noexcept
+    { return (size == 0) ? 0 : (size - 1) / block_alignment; }
+
+    static std::size_t
+    _page_round(std::size_t size) noexcept
+    {
+        const std::size_t _page = detail::page_size();
+        return (size + _page - 1) / _page * _page;
+    }
+
+    /// Regions and shared free lists, kept alive by the thread caches so
+    ///     that they can tell the arena is gone
+    struct _State {
+        explicit _State(map_hook h)
+        : on_map{std::move(h)}
+        { }
+
+        /// Takes a free block of class c, or carves a new one; under mutex
+        _Block*
+        take(std::size_t c)
+        {
+            if (auto _b = free[c]) {
+                free[c] = _b->next;
+                return _b;
+            }
+            const std::size_t _bytes = (c + 1) * block_alignment;
+            if (static_cast<std::size_t>(end - cur) < _bytes) grow();
+            auto _b = reinterpret_cast<_Block*>(cur);
+            cur += _bytes;
+            return _b;
+        }
+
+        /// Puts b on the free list of class c; under mutex
+        void
+        put(std::size_t c, _Block* b) noexcept
+        {
+            b->next = free[c];
+            free[c] = b;
+        }
+
+        /// Maps a new region to carve blocks from; the tail of the current
+        ///     one, smaller than the block requested, is abandoned
+        void
+        grow()
+        {
+            regions.reserve(regions.size() + 1);
+            auto _r = static_cast<char*>(detail::huge_page_map(huge_page_size, false));
+            if (on_map) on_map(_r, huge_page_size);
+            regions.push_back(_r);
+            cur = _r;
+            end = _r + huge_page_size;
+        }
+
+        std::mutex mutex;
+        std::atomic<bool> closed{false};
+        _Block* free[_class_count] = {};
+        char* cur = nullptr;
+        char* end = nullptr;
+        std::vector<void*> regions;
+        const map_hook on_map;
+    };
+
+    /// Free lists of one thread cache
+    struct _Lists {
+        void
+        push(std::size_t c, _Block* b) noexcept
+        {
+            b->next = head[c];
+            head[c] = b;
+            ++n[c];
+        }
+
+        _Block*
+        pop(std::size_t c) noexcept
+        {
+            auto _b = head[c];
+            head[c] = _b->next;
+            --n[c];
+            return _b;
+        }
+
+        _Block* head[_class_count] = {};
+        std::size_t n[_class_count] = {};
+    };
+
+    /// Free blocks of one arena cached by one thread
+    struct _Cache {
+        explicit _Cache(const shared_ptr<_State>& s) noexcept
+        : state{s}
+        { }
+
+        _Cache(_Cache&& c) noexcept
+        : state{std::move(c.state)},
+          lists(c.lists)
+        { c.lists = _Lists{}; }
+
+        _Cache&
+        operator=(_Cache&& c) noexcept
+        {
+            if (this != &c) {
+                flush();
+                state = std::move(c.state);
+                lists = c.lists;
+                c.lists = _Lists{};
+            }
+            return *this;
+        }
+
+        ~_Cache()
+        { flush(); }
+
+        /// Hands the blocks back to the shared free lists, or drops them
+        ///     if the arena is gone
+        void
+        flush() noexcept
+        {
+            if (!state) return;
+            std::lock_guard<std::mutex> _lk{state->mutex};
+            if (!state->closed.load(std::memory_order_relaxed))
+                for (std::size_t _c = 0; _c < _class_count; ++_c)
+                    while (lists.head[_c]) state->put(_c, lists.pop(_c));
+            lists = _Lists{};
+        }
+
+        shared_ptr<_State> state;
+        _Lists lists;
+    };
+
+    /// The caches of the calling thread, one per live arena
+    struct _Caches {
+        ~_Caches()
+        { _exited() = true; }
+
+        std::vector<_Cache> caches;
+    };
+
+    static _Caches&
+    _thread_caches()
+    {
+        static thread_local _Caches _c;
+        return _c;
+    }
+
+    /// Whether the calling thread has destroyed its caches, on exit
+    static bool&
+    _exited()
+    {
+        static thread_local bool _e = false;
+        return _e;
+    }
+
+    /// Gets the calling thread's cache for this arena, dropping caches of
+    ///     arenas destroyed meanwhile; nullptr if there is none
+    _Cache*
+    _local() noexcept
+    {
+        if (_exited()) return nullptr;
+        auto& _v = _thread_caches().caches;
+        for (std::size_t _i = 0; _i < _v.size(); ) {
+            if (_v[_i].state.get() == _state.get()) return &_v[_i];
+            if (_v[_i].state->closed.load(std::memory_order_relaxed)) {
+                std::swap(_v[_i], _v.back());
+                _v.pop_back();
+                continue;
+            }
+            ++_i;
+        }
+        try {
+            _v.emplace_back(_state);
+        } catch (...) {
+            return nullptr;
+        }
+        return &_v.back();
+    }
+
+    shared_ptr<_State> _state;
+};
+
+// Class template arena_allocator, allocator drawing from a huge_page_arena
+
+template<typename T>
+class arena_allocator {
+public:
+    template<typename U>
+    friend class arena_allocator;
+
+    using value_type = T;
+
+    /// Allocates from arena
+    explicit arena_allocator(huge_page_arena& arena) noexcept
+    : _arena{&arena}
+    { }
+
+    /// Converting constructor, allocates from the same arena
+    template<typename U>
+    arena_allocator(const arena_allocator<U>& a) noexcept
+    : _arena{a._arena}
+    { }
+
+    T*
+    allocate(std::size_t n)
+    { return static_cast<T*>(_arena->allocate(n * sizeof(T), alignof(T))); }
+
+    void
+    deallocate(T* p, std::size_t n) noexcept
+    { _arena->deallocate(p, n * sizeof(T), alignof(T)); }
+
+    /// Gets the arena allocated from
+    huge_page_arena&
+    arena() const noexcept
+    { return *_arena; }
+
+private:
+    huge_page_arena* _arena;
+};
+
+template<typename T, typename U>
+    inline bool
+    operator==(const arena_allocator<T>& a1, const arena_allocator<U>& a2) noexcept
+    { return &a1.arena() == &a2.arena(); }
+
+template<typename T, typename U>
+    inline bool
+    operator!=(const arena_allocator<T>& a1, const arena_allocator<U>& a2) noexcept
+    { return !(a1 == a2); }
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block from the global huge page arena
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_arena(Args&&... args)
+    {
+        return smart_ptr::allocate_shared<T>(arena_allocator<T>{huge_page_arena::global()},
+                                             std::forward<Args>(args)...);
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,254 @@
+// lock-free atomic weak_ptr slot
+
+/**
+ * An atomic_weak_slot<T> holds a weak_ptr that threads may store, load and
+ *  lock concurrently without a mutex, e.g. one entry of a cache:
+ *
+ *      atomic_weak_slot<Value> slot;
+ *      slot.store(sp);
+ *      if (auto v = slot.try_lock()) ...       // shared_ptr, empty if expired
+ *      slot.compare_exchange(expected, sp);    // expected is a weak_ptr
+ *
+ * Each store publishes a small node holding the stored pointer, the control
+ *  block and one weak reference on it. The slot is a single 64-bit word, the
+ *  address of the node in its low 48 bits and a count of readers in its
+ *  high 16 bits (split reference counting). A reader pins the node with one
+ *  fetch_add on the word, so that the node, and the control block its weak
+ *  reference keeps, cannot be freed under it; it then reads the node, takes
+ *  the references it needs on the control block, and unpins with a CAS. A
+ *  writer swapping the node out adds the pins still in the word to the
+ *  node's own count, which starts at 0; a reader finding its node swapped
+ *  out subtracts its pin from that count instead, which may thus go
+ *  negative meanwhile. Whichever of the two brings the count to exactly 0
+ *  frees the node, dropping the weak reference.
+ *
+ * No operation takes a lock. Stores allocate a node. Up to 65535 readers
+ *  may pin a slot at a time, and addresses must fit in 48 bits, as they do
+ *  on x86-64 and AArch64 with 4-level page tables.
+ *
+ * See atomic_weak_slot_bench.cpp for a comparison with a weak_ptr behind a
+ *  mutex.
+ */
+
+#ifndef ATOMIC_WEAK_SLOT_HPP
+#define ATOMIC_WEAK_SLOT_HPP 1
+
+#include <cstdint>      // uint64_t, uintptr_t
+#include <atomic>       // atomic
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr {
+
+// Class template atomic_weak_slot
+
+template<typename T>
+class atomic_weak_slot {
+public:
+    using element_type = typename weak_ptr<T>::element_type;
+
+    static_assert(sizeof(void*) == 8, "atomic_weak_slot requires 64-bit pointers");
+
+    /// Default constructor, creates an empty slot
+    atomic_weak_slot() noexcept = default;
+
+    /// Constructs a slot referring to sp's object
+    explicit atomic_weak_slot(const shared_ptr<T>& sp)
+    : _word{_make(sp)}
+    { }
+
+    atomic_weak_slot(const atomic_weak_slot&) = delete;
+    atomic_weak_slot& operator=(const atomic_weak_slot&) = delete;
+
+    ~atomic_weak_slot()
+    { _retire(_word.load(std::memory_order_acquire)); }
+
+    // Modifiers
+
+    /// Makes the slot refer to sp's object
+    void
+    store(const shared_ptr<T>& sp)
+    { _retire(_word.exchange(_make(sp), std::memory_order_acq_rel)); }
+
+    /// Empties the slot
+    void
+    reset() noexcept
+    { _retire(_word.exchange(0, std::memory_order_acq_rel)); }
+
+    /// Makes the slot refer to desired's object if it refers to the same
+    ///     object as expected (same pointer and owner), or else copies what
+    ///     it refers to into expected; true if stored
+    bool
+    compare_exchange(weak_ptr<T>& expected, const shared_ptr<T>& desired)
+    {
+        const std::uint64_t _new = _make(desired);
+        std::uint64_t _w = _pin();
+        _Node* _n = _node(_w);
+        for (;;) {
+            if (!_same(_n, expected)) {
+                expected = _weak(_n);
+                _unpin(_n);
+                _retire(_new);
+                return false;
+            }
+            // Other readers may move the count meanwhile, retry while the
+            //     node is the same
+            if (_word.compare_exchange_weak(_w, _new, std::memory_order_acq_rel,
+                                            std::memory_order_acquire)) {
+                _retire(_w);
+                _unpin(_n);
+                return true;
+            }
+            if (_node(_w) != _n) {
+                _unpin(_n);
+                _w = _pin();
+                _n = _node(_w);
+            }
+        }
+    }
+
+    // Observers
+
+    /// Gets a shared_ptr to the object, empty if there is none or it has
+    ///     expired
+    shared_ptr<T>
+    try_lock() const noexcept
+    {
+        _Node* _n = _node(_pin());
+        shared_ptr<T> _sp;
+        if (_n && _n->cb->try_inc_ref())
+            _sp = detail::sp_access::adopt<T>(_n->ptr, _n->cb);
+        _unpin(_n);
+        return _sp;
+    }
+
+    /// Gets a weak_ptr to the object
+    weak_ptr<T>
+    load() const noexcept
+    {
+        _Node* _n = _node(_pin());
+        weak_ptr<T> _wp = _weak(_n);
+        _unpin(_n);
+        return _wp;
+    }
+
+    /// Whether there is no object, or it has expired
+    bool
+    expired() const noexcept
+    {
+        _Node* _n = _node(_pin());
+        const bool _e = !_n || _n->cb->expired();
+        _unpin(_n);
+        return _e;
+    }
+
+    /// Whether the slot's word is lock-free, as it is on 64-bit platforms
+    bool
+    is_lock_free() const noexcept
+    { return _word.is_lock_free(); }
+
+private:
+    /// One stored value, keeping a weak reference on cb
+    struct _Node {
+        element_type* ptr;
+        detail::control_block_base* cb;
+        std::atomic<long> refs;  // pins handed over less pins dropped since
+    };
+
+    static constexpr int _count_shift = 48;
+    static constexpr std::uint64_t _count_one = std::uint64_t{1} << _count_shift;
+    static constexpr std::uint64_t _ptr_mask = _count_one - 1;
+
+    static _Node*
+    _node(std::uint64_t w) noexcept
+    { return reinterpret_cast<_Node*>(static_cast<std::uintptr_t>(w & _ptr_mask)); }
+
+    /// Creates the node for sp, 0 if sp is empty or allows no weak_ptr
+    static std::uint64_t
+    _make(const shared_ptr<T>& sp)
+    {
+        auto _cb = detail::sp_access::get_control_block(sp);
+        if (!_cb || !_cb->weak_enabled()) return 0;
+        auto _n = new _Node{sp.get(), _cb, {0}};
+        _cb->inc_wref();
+        return static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(_n));
+    }
+
+    /// Frees n, whose count has come to 0
+    static void
+    _free(_Node* n) noexcept
+    {
+        n->cb->dec_wref();
+        delete n;
+    }
+
+    /// Called on a word swapped out of the slot: hands its pins over to
+    ///     the node, which is freed here if their readers are all done
+    static void
+    _retire(std::uint64_t w) noexcept
+    {
+        if (_Node* _n = _node(w)) {
+            const long _pins = static_cast<long>(w >> _count_shift);
+            if (_n->refs.fetch_add(_pins, std::memory_order_acq_rel) == -_pins)
+                _free(_n);
+        }
+    }
+
+    /// Pins the current node, returns the word seen
+    std::uint64_t
+    _pin() const noexcept
+    { return _word.fetch_add(_count_one, std::memory_order_acq_rel) + _count_one; }
+
+    /// Unpins n, from the word if it is still there, or else from the
+    ///     node's count, freeing it if the pins have been handed over and
+    ///     this was the last; an empty slot needs no pin, its count is
+    ///     merely kept from underflowing
+    void
+    _unpin(_Node* n) const noexcept
+    {
+        std::uint64_t _w = _word.load(std::memory_order_relaxed);
+        while (_node(_w) == n) {
+            // A store may have wiped the pins of an empty slot
+            if (!n && (_w >> _count_shift) == 0) return;
+            if (_word.compare_exchange_weak(_w, _w - _count_one,
+                                            std::memory_order_acq_rel,
+                                            std::memory_order_relaxed))
+                return;
+        }
+        if (n && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            _free(n);
+    }
+
+    static bool
+    _same(_Node* n, const weak_ptr<T>& wp) noexcept
+    {
+        if (!n) return !detail::wp_access::get_control_block(wp);
+        return n->cb == detail::wp_access::get_control_block(wp)
+            && n->ptr == detail::wp_access::get(wp);
+    }
+
+    static weak_ptr<T>
+    _weak(_Node* n) noexcept
+    {
+        if (!n) return weak_ptr<T>{};
+        n->cb->inc_wref();
+        return detail::wp_access::adopt<T>(n->ptr, n->cb);
+    }
+
+    mutable std::atomic<std::uint64_t> _word{0};
+};
+
+template<typename T>
+constexpr int atomic_weak_slot<T>::_count_shift;
+
+template<typename T>
+constexpr std::uint64_t atomic_weak_slot<T>::_count_one;
+
+template<typename T>
+constexpr std::uint64_t atomic_weak_slot<T>::_ptr_mask;
+
+} // namespace smart_ptr
+
+#endif
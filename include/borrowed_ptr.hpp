@@ -0,0 +1,214 @@
+// borrowed_ptr implementation
+
+/**
+ * borrowed_ptr is a non-owning view of an object managed by a shared_ptr.
+ *  Passing a shared_ptr by value costs an atomic increment and decrement;
+ *  passing a borrowed_ptr costs nothing, as it never touches the control
+ *  block. A callee that turns out to need ownership calls to_shared(),
+ *  which takes exactly one reference.
+ *
+ *      void visit(borrowed_ptr<Node> n);      // instead of shared_ptr<Node>
+ *      visit(sp);                             // no reference counting
+ *
+ * The caller must keep a shared_ptr alive while the object is borrowed.
+ *  Defining SMART_PTR_CHECKED_BORROW makes borrowed_ptr hold a weak
+ *  reference on the control block, and assert on every access that the
+ *  object is still alive, which costs atomic operations on every copy.
+ *  The layout is the same in both modes, but copying differs, so all
+ *  translation units of a program must agree on the macro.
+ */
+
+#ifndef BORROWED_PTR_HPP
+#define BORROWED_PTR_HPP 1
+
+#include <cstddef>      // nullptr_t
+#include <cassert>      // assert
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+// Class template borrowed_ptr
+
+template<typename T>
+class borrowed_ptr {
+public:
+    template<typename U>
+    friend class borrowed_ptr;
+
+    using element_type = typename shared_ptr<T>::element_type;
+
+    // constructors
+
+    /// Default constructor, creates a borrowed_ptr that refers to nothing
+    constexpr borrowed_ptr() noexcept
+    : _ptr{},
+      _control_block{}
+    { }
+
+    /// Constructs with nullptr, creates a borrowed_ptr that refers to nothing
+    constexpr borrowed_ptr(std::nullptr_t) noexcept
+    : _ptr{},
+      _control_block{}
+    { }
+
+    /// Borrows the object managed by sp, without taking a reference
+    template<typename U>
+    borrowed_ptr(const shared_ptr<U>& sp) noexcept
+    : _ptr{sp.get()},
+      _control_block{detail::sp_access::get_control_block(sp)}
+    { _retain(); }
+
+    /// Disables borrowing from a temporary, which would dangle at once
+    template<typename U>
+    borrowed_ptr(shared_ptr<U>&&) = delete;
+
+    /// Converting constructor: borrows the object bp refers to
+    template<typename U>
+    borrowed_ptr(const borrowed_ptr<U>& bp) noexcept
+    : _ptr{bp._ptr},
+      _control_block{bp._control_block}
+    { _retain(); }
+
+#ifdef SMART_PTR_CHECKED_BORROW
+    // Copy and destruction maintain the weak reference
+
+    borrowed_ptr(const borrowed_ptr& bp) noexcept
+    : _ptr{bp._ptr},
+      _control_block{bp._control_block}
+    { _retain(); }
+
+    borrowed_ptr&
+    operator=(const borrowed_ptr& bp) noexcept
+    {
+        bp._retain();
+        _release();
+        _ptr = bp._ptr;
+        _control_block = bp._control_block;
+        return *this;
+    }
+
+    ~borrowed_ptr()
+    { _release(); }
+#endif
+
+    // observers
+
+    /// Gets the stored pointer
+    element_type*
+    get() const noexcept
+    {
+        _check();
+        return _ptr;
+    }
+
+    /// Dereferences pointer to the object
+    element_type&
+    operator*() const noexcept
+    {
+        assert(_ptr != nullptr);
+        return *get();
+    }
+
+    /// Dereferences pointer to the object
+    element_type*
+    operator->() const noexcept
+    {
+        assert(_ptr != nullptr);
+        return get();
+    }
+
+    /// Checks if there is an associated object
+    explicit operator bool() const noexcept
+    { return (_ptr) ? true : false; }
+
+    /// Promotes to a shared_ptr that shares ownership with the shared_ptr
+    ///     borrowed from, taking exactly one reference; empty if the object
+    ///     has expired, which needs its control block to be still allocated
+    ///     (always so when checked)
+    shared_ptr<T>
+    to_shared() const noexcept
+    {
+        _check();
+        if (!_control_block || !_control_block->try_inc_ref())
+            return shared_ptr<T>{};
+        return detail::sp_access::adopt<T>(_ptr, _control_block);
+    }
+
+private:
+    /// Whether a checked borrowed_ptr holds a weak reference, which needs
+    ///     a control block that keeps weak counts
+    bool
+    _guarded() const noexcept
+    { return _control_block && _control_block->weak_enabled(); }
+
+    /// Takes the weak reference of a checked borrowed_ptr
+    void
+    _retain() const noexcept
+    {
+#ifdef SMART_PTR_CHECKED_BORROW
+        if (_guarded()) _control_block->inc_wref();
+#endif
+    }
+
+    /// Drops the weak reference of a checked borrowed_ptr
+    void
+    _release() noexcept
+    {
+#ifdef SMART_PTR_CHECKED_BORROW
+        if (_guarded()) _control_block->dec_wref();
+#endif
+    }
+
+    /// Asserts that the object borrowed is still owned by someone
+    void
+    _check() const noexcept
+    {
+#ifdef SMART_PTR_CHECKED_BORROW
+        assert((!_guarded() || !_control_block->expired()) &&
+               "borrowed_ptr used after the shared_ptr it borrows from was released");
+#endif
+    }
+
+    element_type* _ptr;
+    detail::control_block_base* _control_block;
+};
+
+// borrowed_ptr comparisons
+
+/// Operator == overloading
+template<typename T, typename U>
+    inline bool
+    operator==(const borrowed_ptr<T>& bp1, const borrowed_ptr<U>& bp2) noexcept
+    { return bp1.get() == bp2.get(); }
+
+template<typename T>
+    inline bool
+    operator==(const borrowed_ptr<T>& bp, std::nullptr_t) noexcept
+    { return !bp; }
+
+template<typename T>
+    inline bool
+    operator==(std::nullptr_t, const borrowed_ptr<T>& bp) noexcept
+    { return !bp; }
+
+/// Operator != overloading
+template<typename T, typename U>
+    inline bool
+    operator!=(const borrowed_ptr<T>& bp1, const borrowed_ptr<U>& bp2) noexcept
+    { return bp1.get() != bp2.get(); }
+
+template<typename T>
+    inline bool
+    operator!=(const borrowed_ptr<T>& bp, std::nullptr_t) noexcept
+    { return bool{bp}; }
+
+template<typename T>
+    inline bool
+    operator!=(std::nullptr_t, const borrowed_ptr<T>& bp) noexcept
+    { return bool{bp}; }
+
+} // namespace smart_ptr
+
+#endif
@@ -3,14 +3,27 @@
 #ifndef CONTROL_BLOCK_HPP
 #define CONTROL_BLOCK_HPP 1
 
-#include <memory>       // allocator, addressof
+#include <cstddef>      // size_t
+#include <cstdint>      // uintptr_t
+#include <new>          // operator new, operator delete, bad_array_new_length
+#include <memory>       // allocator, allocator_traits, addressof
+#include <tuple>        // tuple, get(tuple)
 #include <atomic>       // atomic
+#include <limits>       // numeric_limits
+#include <utility>      // forward
+#include <type_traits>  // remove_cv, aligned_storage
 
 #include "ptr.hpp"
 #include "default_delete.hpp"
+#include "allocate.hpp"
+#include "expiry.hpp"
 
 namespace smart_ptr {
 
+/// use_count() reported by shared_ptrs to immortal objects,
+///     see make_immortal_shared
+constexpr long immortal_use_count = std::numeric_limits<long>::max();
+
 namespace detail {
 
 // control block interface
@@ -25,12 +38,168 @@ public:
     virtual void dec_ref() noexcept = 0;
     virtual void dec_wref() noexcept = 0;
 
+    // Counted variants: n references taken/dropped with a single RMW
+    virtual void inc_ref(long n) noexcept = 0;
+    virtual void dec_ref(long n) noexcept = 0;
+
+    // Takes a strong reference unless the object has expired, atomically
+    virtual bool try_inc_ref() noexcept = 0;
+
     virtual long use_count() const noexcept = 0;
     virtual bool unique() const noexcept = 0;
     virtual long weak_use_count() const noexcept = 0;
     virtual bool expired() const noexcept = 0;
 
     virtual void* get_deleter() noexcept = 0;
+
+    // Whether weak_ptrs may refer to this control block
+    virtual bool weak_enabled() const noexcept { return true; }
+
+    // Gets the list of expiry callbacks, created on first use; nullptr
+    // once the object has expired, or if it never does.
+    // See weak_ptr::on_expire
+    virtual expiry_list* expiry_callbacks() { return nullptr; }
+
+    // Control blocks are freed by a virtual destructor, which passes the
+    // size of the actual block, so the allocator need not look it up
+
+    static void*
+    operator new(std::size_t size)
+    { return allocate(size); }
+
+    static void
+    operator delete(void* p, std::size_t size) noexcept
+    { deallocate(p, size); }
+
+#ifdef __cpp_aligned_new
+    static void*
+    operator new(std::size_t size, std::align_val_t align)
+    { return allocate(size, static_cast<std::size_t>(align)); }
+
+    static void
+    operator delete(void* p, std::size_t size, std::align_val_t align) noexcept
+    { deallocate(p, size, static_cast<std::size_t>(align)); }
+#endif
+};
+
+// reference counting shared by the control blocks that own their object
+
+/**
+ * Keeps the strong and weak counts. Derived control blocks only say how to
+ *  destroy the managed object (dispose), which happens when the last
+ *  shared_ptr goes, and how to free themselves (destroy), which happens
+ *  when the last shared_ptr or weak_ptr goes.
+ *
+ * It also points to the block's expiry callbacks, if any were registered,
+ *  the low bit of the pointer marking the object expired.
+ */
+
+class counted_control_block : public control_block_base {
+public:
+    // Modifiers
+
+    void
+    inc_ref() noexcept override
+    { ++_use_count; }
+
+    void
+    inc_wref() noexcept override
+    { ++_weak_use_count; }
+
+    void
+    dec_ref() noexcept override
+    { dec_ref(1); }
+
+    void
+    dec_wref() noexcept override
+    {
+        if (_weak_use_count.fetch_sub(1) == 1) {
+            if (auto _l = _list(_expiry.load(std::memory_order_acquire)))
+                _l->release();
+            destroy(); // destroy control_block itself
+        }
+    }
+
+    void
+    inc_ref(long n) noexcept override
+    { _use_count.fetch_add(n); }
+
+    void
+    dec_ref(long n) noexcept override
+    {
+        if (_use_count.fetch_sub(n) == n) {
+            dispose(); // destroy the managed object
+            // Marking the object expired orders the callbacks after dispose,
+            //     and turns away registrations that come too late
+            if (auto _l = _list(_expiry.fetch_or(_expired, std::memory_order_acq_rel)))
+                _l->close();
+            dec_wref();
+        }
+    }
+
+    expiry_list*
+    expiry_callbacks() override
+    {
+        auto _v = _expiry.load(std::memory_order_acquire);
+        if (_v == 0) {
+            auto _fresh = new expiry_list;
+            const auto _new = reinterpret_cast<std::uintptr_t>(_fresh);
+            if (_expiry.compare_exchange_strong(_v, _new, std::memory_order_acq_rel,
+                                                std::memory_order_acquire))
+                return _fresh;
+            _fresh->release();
+        }
+        return (_v & _expired) ? nullptr : _list(_v);
+    }
+
+    bool
+    try_inc_ref() noexcept override
+    {
+        long _n = _use_count.load();
+        while (_n != 0) {
+            if (_use_count.compare_exchange_weak(_n, _n + 1)) return true;
+        }
+        return false;
+    }
+
+    // Observers
+
+    long
+    use_count() const noexcept override // Returns #shared_ptr
+    { return _use_count; }
+
+    bool
+    unique() const noexcept override
+    { return _use_count == 1; }
+
+    long
+    weak_use_count() const noexcept override // Returns #weak_ptr
+    { return _weak_use_count - ((_use_count > 0) ? 1 : 0); }
+
+    bool
+    expired() const noexcept override
+    { return _use_count == 0; }
+
+protected:
+    /// Destroys the managed object
+    virtual void dispose() noexcept = 0;
+
+    /// Frees the control block itself
+    virtual void destroy() noexcept = 0;
+
+private:
+    /// Bit of _expiry set once the object has expired
+    static constexpr std::uintptr_t _expired = 1;
+
+    /// The callbacks an _expiry value points to, nullptr if none,
+    ///     whether the object has expired or not
+    static expiry_list*
+    _list(std::uintptr_t v) noexcept
+    { return reinterpret_cast<expiry_list*>(v & ~_expired); }
+
+    std::atomic<long> _use_count{1};
+    std::atomic<long> _weak_use_count{1}; // Note: _weak_use_count = #weak_ptrs + (#shared_ptr > 0) ? 1 : 0
+    std::atomic<std::uintptr_t> _expiry{0};
 };
 
 // control block for reference counting of shared_ptr and weak_ptr
@@ -40,10 +209,11 @@ public:
  * 
  * The allocator is intended to be used to allocate and deallocate
  *  internal shared_ptr details, not the object.
+ *  (allocate_shared is supported, see inplace_alloc_control_block.)
  */
 
 template<typename T, typename D = default_delete<T>>
-class control_block : public control_block_base {
+class control_block : public counted_control_block {
 public:
     using element_type = T;
     using deleter_type = D;
@@ -64,6 +234,446 @@ public:
     ~control_block()
     { }
 
+    // Observers
+
+    void*
+    get_deleter() noexcept override // Type erasure for storing deleter
+    { return reinterpret_cast<void*>(std::addressof(_impl._impl_deleter())); }
+
+protected:
+    void
+    dispose() noexcept override
+    {
+        auto _ptr = _impl._impl_ptr();
+        auto& _deleter = _impl._impl_deleter();
+        if (_ptr) _deleter(_ptr); // destroy the object _ptr points to
+    }
+
+    void
+    destroy() noexcept override
+    { delete this; }
+
+private:
+    Ptr<T, D> _impl;
+};
+
+// control block holding the object in place
+
+/**
+ * The object is constructed inside the control block, so make_shared needs
+ *  a single allocation. The price is that the object's storage is only
+ *  returned when the control block goes, i.e. once the last weak_ptr is
+ *  gone too, even though the object itself was destroyed as soon as the
+ *  last shared_ptr went.
+ *
+ * Align raises the alignment of the object's storage. Aligned to a cache
+ *  line, the storage starts on the line after the counts, and the block
+ *  spans whole lines, so that the counts share their line with neither the
+ *  object nor a neighbouring allocation.
+ */
+
+template<typename T, std::size_t Align = alignof(T)>
+class inplace_control_block : public counted_control_block {
+public:
+    using element_type = T;
+
+    // Constructors
+
+    template<typename... Args>
+    explicit inplace_control_block(Args&&... args)
+    { ::new (static_cast<void*>(_object())) _Obj{std::forward<Args>(args)...}; }
+
+    // Observers
+
+    void*
+    get_deleter() noexcept override // The object is destroyed in place
+    { return nullptr; }
+
+    T*
+    get() noexcept
+    { return _object(); }
+
+    // Allocated with the alignment of the object held in place
+
+    static void*
+    operator new(std::size_t size)
+    { return allocate(size, alignof(inplace_control_block)); }
+
+    static void
+    operator delete(void* p, std::size_t size) noexcept
+    { deallocate(p, size, alignof(inplace_control_block)); }
+
+protected:
+    void
+    dispose() noexcept override
+    { _object()->~_Obj(); }
+
+    void
+    destroy() noexcept override
+    { delete this; }
+
+private:
+    using _Obj = typename std::remove_cv<T>::type;
+
+    _Obj*
+    _object() noexcept
+    { return reinterpret_cast<_Obj*>(std::addressof(_storage)); }
+
+    typename std::aligned_storage<sizeof(_Obj),
+        (Align > alignof(_Obj)) ? Align : alignof(_Obj)>::type _storage;
+};
+
+// control block holding the object in place, allocated by an allocator
+
+/**
+ * Used by allocate_shared. The allocator, rebound to the control block
+ *  type, allocates the single block holding both the counts and the
+ *  object, and is kept in the block to free it. It is stored in a tuple
+ *  along with the object storage, so a stateless allocator takes no space.
+ */
+
+template<typename T, typename A>
+class inplace_alloc_control_block : public counted_control_block {
+    using _Obj = typename std::remove_cv<T>::type;
+    using _Alloc = typename std::allocator_traits<A>::template
+        rebind_alloc<inplace_alloc_control_block>;
+    using _Traits = std::allocator_traits<_Alloc>;
+    using _ObjAlloc = typename std::allocator_traits<A>::template rebind_alloc<_Obj>;
+    using _ObjTraits = std::allocator_traits<_ObjAlloc>;
+
+public:
+    using element_type = T;
+    using allocator_type = A;
+
+    /// Allocates a block with a, and constructs the object from args in it
+    template<typename... Args>
+    static inplace_alloc_control_block*
+    create(const A& a, Args&&... args)
+    {
+        _Alloc _a{a};
+        auto _mem = _Traits::allocate(_a, 1);
+        try {
+            return ::new (static_cast<void*>(_mem))
+                inplace_alloc_control_block{_a, std::forward<Args>(args)...};
+        } catch (...) {
+            _Traits::deallocate(_a, _mem, 1);
+            throw;
+        }
+    }
+
+    // Observers
+
+    void*
+    get_deleter() noexcept override // The object is destroyed in place
+    { return nullptr; }
+
+    T*
+    get() noexcept
+    { return _object(); }
+
+protected:
+    void
+    dispose() noexcept override
+    {
+        _ObjAlloc _a{_alloc()};
+        _ObjTraits::destroy(_a, _object());
+    }
+
+    void
+    destroy() noexcept override
+    {
+        _Alloc _a{_alloc()};
+        this->~inplace_alloc_control_block();
+        _Traits::deallocate(_a, this, 1);
+    }
+
+private:
+    using _Storage = typename std::aligned_storage<sizeof(_Obj), alignof(_Obj)>::type;
+
+    template<typename... Args>
+    explicit inplace_alloc_control_block(const _Alloc& a, Args&&... args)
+    : _impl{_Storage{}, a}
+    {
+        _ObjAlloc _a{a};
+        _ObjTraits::construct(_a, _object(), std::forward<Args>(args)...);
+    }
+
+    _Obj*
+    _object() noexcept
+    { return reinterpret_cast<_Obj*>(std::addressof(std::get<0>(_impl))); }
+
+    _Alloc&
+    _alloc() noexcept
+    { return std::get<1>(_impl); }
+
+    std::tuple<_Storage, _Alloc> _impl;
+};
+
+// control block for a batch of objects sharing one allocation
+
+/**
+ * The control block and an array of n objects are carved out of a single
+ *  allocation, with the objects laid out contiguously right after the
+ *  block. All objects share the one pair of counts: they are destroyed
+ *  together when the last shared_ptr to any of them goes.
+ */
+
+template<typename T>
+class batch_control_block : public counted_control_block {
+public:
+    using element_type = T;
+
+    /// Allocates a block followed by n objects, each constructed from args;
+    ///     throws bad_array_new_length if their size overflows
+    template<typename... Args>
+    static batch_control_block*
+    create(std::size_t n, const Args&... args)
+    {
+        if (n > (std::numeric_limits<std::size_t>::max() - _objects_offset()) / sizeof(_Obj))
+            throw std::bad_array_new_length{};
+        void* _mem = allocate(_size(n), _align());
+        auto _cb = ::new (_mem) batch_control_block{n};
+        auto _objs = _cb->_objects();
+        std::size_t _i = 0;
+        try {
+            for (; _i < n; ++_i)
+                ::new (static_cast<void*>(_objs + _i)) _Obj{args...};
+        } catch (...) {
+            for (; _i > 0; --_i)
+                _objs[_i - 1].~_Obj();
+            _cb->~batch_control_block();
+            deallocate(_mem, _size(n), _align());
+            throw;
+        }
+        return _cb;
+    }
+
+    // Observers
+
+    void*
+    get_deleter() noexcept override // The objects are destroyed in place
+    { return nullptr; }
+
+    /// Gets the first object of the batch
+    T*
+    get() noexcept
+    { return _objects(); }
+
+protected:
+    void
+    dispose() noexcept override
+    {
+        auto _objs = _objects();
+        for (std::size_t _i = _n; _i > 0; --_i)
+            _objs[_i - 1].~_Obj();
+    }
+
+    void
+    destroy() noexcept override
+    {
+        const std::size_t _bytes = _size(_n);
+        this->~batch_control_block();
+        deallocate(static_cast<void*>(this), _bytes, _align());
+    }
+
+private:
+    using _Obj = typename std::remove_cv<T>::type;
+
+    explicit batch_control_block(std::size_t n)
+    : _n{n}
+    { }
+
+    /// Offset of the first object, past the block and aligned for T
+    static constexpr std::size_t
+    _objects_offset() noexcept
+    {
+        return (sizeof(batch_control_block) + alignof(_Obj) - 1)
+            / alignof(_Obj) * alignof(_Obj);
+    }
+
+    /// Size of the allocation holding the block and n objects
+    static constexpr std::size_t
+    _size(std::size_t n) noexcept
+    { return _objects_offset() + n * sizeof(_Obj); }
+
+    /// Alignment of the allocation holding the block and the objects
+    static constexpr std::size_t
+    _align() noexcept
+    {
+        return (alignof(batch_control_block) > alignof(_Obj))
+            ? alignof(batch_control_block) : alignof(_Obj);
+    }
+
+    _Obj*
+    _objects() noexcept
+    {
+        return reinterpret_cast<_Obj*>(
+            reinterpret_cast<char*>(this) + _objects_offset());
+    }
+
+    std::size_t _n;
+};
+
+// control blocks living in an ownership_arena
+
+/**
+ * The block's memory belongs to the arena it was bump-allocated from, and
+ *  is only freed when the whole arena is. destroy therefore merely marks
+ *  the block released. Blocks are chained, so that the arena can tell on
+ *  its destruction whether any of them is still referenced.
+ */
+
+class arena_block_base : public counted_control_block {
+public:
+    /// Whether the last shared_ptr and weak_ptr to the block are gone
+    bool
+    released() const noexcept
+    { return _released.load(std::memory_order_acquire); }
+
+    /// Next block allocated from the same arena
+    arena_block_base* next = nullptr;
+
+protected:
+    void
+    destroy() noexcept override
+    { _released.store(true, std::memory_order_release); }
+
+private:
+    std::atomic<bool> _released{false};
+};
+
+template<typename T>
+class arena_control_block : public arena_block_base {
+public:
+    using element_type = T;
+
+    // Constructors
+
+    template<typename... Args>
+    explicit arena_control_block(Args&&... args)
+    { ::new (static_cast<void*>(_object())) _Obj{std::forward<Args>(args)...}; }
+
+    // Observers
+
+    void*
+    get_deleter() noexcept override // The object is destroyed in place
+    { return nullptr; }
+
+    T*
+    get() noexcept
+    { return _object(); }
+
+protected:
+    void
+    dispose() noexcept override
+    { _object()->~_Obj(); }
+
+private:
+    using _Obj = typename std::remove_cv<T>::type;
+
+    _Obj*
+    _object() noexcept
+    { return reinterpret_cast<_Obj*>(std::addressof(_storage)); }
+
+    typename std::aligned_storage<sizeof(_Obj), alignof(_Obj)>::type _storage;
+};
+
+// control block for immortal objects
+
+/**
+ * The object lives inside the control block, and neither of them is ever
+ *  destroyed. Since nothing can be freed, reference counting is skipped
+ *  altogether: copying and destroying a shared_ptr to an immortal object
+ *  never writes to the control block, so threads sharing it do not contend
+ *  on the cache line.
+ */
+
+template<typename T>
+class immortal_control_block : public control_block_base {
+public:
+    using element_type = T;
+
+    // Constructors
+
+    template<typename... Args>
+    explicit immortal_control_block(Args&&... args)
+    : _obj{std::forward<Args>(args)...}
+    { }
+
+    // Modifiers, all no-ops
+
+    void inc_ref() noexcept override { }
+    void inc_wref() noexcept override { }
+    void dec_ref() noexcept override { }
+    void dec_wref() noexcept override { }
+    void inc_ref(long) noexcept override { }
+    void dec_ref(long) noexcept override { }
+    bool try_inc_ref() noexcept override { return true; }
+
+    // Observers
+
+    long
+    use_count() const noexcept override
+    { return immortal_use_count; }
+
+    bool
+    unique() const noexcept override
+    { return false; }
+
+    long
+    weak_use_count() const noexcept override
+    { return 0; }
+
+    bool
+    expired() const noexcept override
+    { return false; }
+
+    void*
+    get_deleter() noexcept override // No deleter is ever called
+    { return nullptr; }
+
+    T*
+    get() noexcept
+    { return std::addressof(_obj); }
+
+    // Allocated with the alignment of the object held in place
+
+    static void*
+    operator new(std::size_t size)
+    { return allocate(size, alignof(immortal_control_block)); }
+
+    static void
+    operator delete(void* p, std::size_t size) noexcept
+    { deallocate(p, size, alignof(immortal_control_block)); }
+
+private:
+    typename std::remove_cv<T>::type _obj;
+};
+
+// control block without weak reference count
+
+/**
+ * The object lives inside the control block, so a single allocation holds
+ *  both. Only a strong count is kept: the last shared_ptr to go destroys
+ *  the object and frees the block after one atomic decrement, without the
+ *  weak count round trip of control_block::dec_ref.
+ *
+ * weak_ptrs cannot refer to it. A weak_ptr formed from a shared_ptr that
+ *  owns such a block is empty (and therefore expired).
+ */
+
+template<typename T>
+class noweak_control_block : public control_block_base {
+public:
+    using element_type = T;
+
+    // Constructors
+
+    template<typename... Args>
+    explicit noweak_control_block(Args&&... args)
+    : _obj{std::forward<Args>(args)...}
+    { }
+
     // Modifiers
 
     void
@@ -72,31 +682,42 @@ public:
 
     void
     inc_wref() noexcept override
-    { ++_weak_use_count; }
+    { }
 
     void
     dec_ref() noexcept override
+    { dec_ref(1); }
+
+    void
+    dec_wref() noexcept override
+    { }
+
+    void
+    inc_ref(long n) noexcept override
+    { _use_count.fetch_add(n); }
+
+    void
+    dec_ref(long n) noexcept override
     {
-        auto _ptr = _impl._impl_ptr();
-        auto& _deleter = _impl._impl_deleter();
-        if (--_use_count == 0) {
-            if (_ptr) _deleter(_ptr); // destroy the object _ptr points to
-            dec_wref();
+        if (_use_count.fetch_sub(n) == n) {
+            delete this; // destroys the object along with the control block
         }
     }
 
-    void
-    dec_wref() noexcept override
+    bool
+    try_inc_ref() noexcept override
     {
-        if (--_weak_use_count == 0) {
-            delete this; // destroy control_block itself
+        long _n = _use_count.load();
+        while (_n != 0) {
+            if (_use_count.compare_exchange_weak(_n, _n + 1)) return true;
         }
+        return false;
     }
 
     // Observers
 
     long
-    use_count() const noexcept override // Returns #shared_ptr
+    use_count() const noexcept override
     { return _use_count; }
 
     bool
@@ -104,21 +725,38 @@ public:
     { return _use_count == 1; }
 
     long
-    weak_use_count() const noexcept override // Returns #weak_ptr
-    { return _weak_use_count - ((_use_count > 0) ? 1 : 0); }
+    weak_use_count() const noexcept override
+    { return 0; }
 
     bool
     expired() const noexcept override
     { return _use_count == 0; }
 
     void*
-    get_deleter() noexcept override // Type erasure for storing deleter
-    { return reinterpret_cast<void*>(std::addressof(_impl._impl_deleter())); }
+    get_deleter() noexcept override // The object is destroyed in place
+    { return nullptr; }
+
+    bool
+    weak_enabled() const noexcept override
+    { return false; }
+
+    T*
+    get() noexcept
+    { return std::addressof(_obj); }
+
+    // Allocated with the alignment of the object held in place
+
+    static void*
+    operator new(std::size_t size)
+    { return allocate(size, alignof(noweak_control_block)); }
+
+    static void
+    operator delete(void* p, std::size_t size) noexcept
+    { deallocate(p, size, alignof(noweak_control_block)); }
 
 private:
     std::atomic<long> _use_count{1};
-    std::atomic<long> _weak_use_count{1}; // Note: _weak_use_count = #weak_ptrs + (#shared_ptr > 0) ? 1 : 0
-    Ptr<T, D> _impl;
+    typename std::remove_cv<T>::type _obj;
 };
 
 } // namespace detail
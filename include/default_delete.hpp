@@ -8,6 +8,8 @@
 #ifndef DEFAULT_DELETE_HPP
 #define DEFAULT_DELETE_HPP 1
 
+#include <utility>      // forward
+
 namespace smart_ptr {
 
 // 20.7.1.1 Default deleters
@@ -50,6 +52,28 @@ public:
     { delete[] p; }
 };
 
+// deleter_fn, a stateless deleter calling a function known at compile time
+
+/**
+ * A function pointer deleter, as in unique_ptr<FILE, decltype(&fclose)>,
+ *  is stored in every smart pointer. Naming the function in the deleter's
+ *  type instead, as in unique_ptr<FILE, deleter_fn<decltype(&fclose), &fclose>>,
+ *  makes the deleter an empty class, which takes no space thanks to EBO.
+ */
+
+template <typename F, F f>
+class deleter_fn
+{
+public:
+    /// Default constructor
+    constexpr deleter_fn() noexcept = default;
+
+    /// Call operator, calls f with the resource to release
+    template <typename... Args>
+    void operator()(Args&&... args) const
+    { f(std::forward<Args>(args)...); }
+};
+
 } // namespace smart_ptr
 
 #endif
@@ -0,0 +1,228 @@
+// expiry callbacks of weak_ptr
+
+/**
+ * weak_ptr::on_expire(f) registers f to be called when the last shared_ptr
+ *  to the object goes, right after the object is destroyed, on the thread
+ *  that dropped that shared_ptr. A container of weak_ptrs can thus remove
+ *  an entry as soon as it expires, instead of sweeping all entries with
+ *  expired():
+ *
+ *      auto token = wp.on_expire([&] { cache.erase(key); });
+ *      ...
+ *      token.cancel();                 // no longer interested
+ *
+ * A control block only points to its callbacks, a null pointer until the
+ *  first one is registered, so a block nobody watches stores one word and
+ *  takes no lock. The callbacks of a block are kept in an expiry_list,
+ *  guarded by a spinlock of its own, which the block and the tokens of its
+ *  callbacks share. The last shared_ptr marks the pointer expired and runs
+ *  the callbacks; a registration that finds the mark runs its callback at
+ *  once, so every callback runs exactly once unless cancelled.
+ *
+ * The callback is called at once if the weak_ptr is empty or expired, and
+ *  never if the object is immortal. Callbacks must not throw.
+ */
+
+#ifndef EXPIRY_HPP
+#define EXPIRY_HPP 1
+
+#include <cstddef>      // size_t
+#include <atomic>       // atomic, atomic_flag
+
+namespace smart_ptr {
+
+namespace detail {
+
+// Class expiry_callback, a callback registered with on_expire
+
+class expiry_callback {
+public:
+    virtual ~expiry_callback() { }
+
+    virtual void run() noexcept = 0;
+
+    expiry_callback* next = nullptr;
+    std::size_t id = 0;
+};
+
+// Class expiry_list, the callbacks of one control block
+
+/**
+ * Reference counted: the control block holds one reference until it is
+ *  freed, and each expiry_token one, so that cancelling after the block is
+ *  gone is safe.
+ */
+
+class expiry_list {
+public:
+    expiry_list() = default;
+
+    expiry_list(const expiry_list&) = delete;
+    expiry_list& operator=(const expiry_list&) = delete;
+
+    /// Adds cb, which the list then owns, and returns its id; returns 0
+    ///     if the list is closed, leaving cb to the caller
+    std::size_t
+    add(expiry_callback* cb) noexcept
+    {
+        _lock();
+        if (_closed) {
+            _unlock();
+            return 0;
+        }
+        const std::size_t _id = ++_last_id;
+        cb->id = _id;
+        cb->next = _head;
+        _head = cb;
+        _unlock(); // cb may run and be freed from here on
+        return _id;
+    }
+
+    /// Removes and frees the callback id; false if it has run or is running
+    bool
+    remove(std::size_t id) noexcept
+    {
+        _lock();
+        expiry_callback* _found = nullptr;
+        for (auto _link = &_head; *_link; _link = &(*_link)->next) {
+            if ((*_link)->id == id) {
+                _found = *_link;
+                *_link = _found->next;
+                break;
+            }
+        }
+        _unlock();
+        delete _found;
+        return _found != nullptr;
+    }
+
+    /// Runs and frees all callbacks in the order they were added, and
+    ///     closes the list to new ones
+    void
+    close() noexcept
+    {
+        _lock();
+        _closed = true;
+        expiry_callback* _cb = _head;
+        _head = nullptr;
+        _unlock();
+
+        expiry_callback* _ordered = nullptr;
+        while (_cb) {
+            auto _next = _cb->next;
+            _cb->next = _ordered;
+            _ordered = _cb;
+            _cb = _next;
+        }
+        while (_ordered) {
+            auto _next = _ordered->next;
+            _ordered->run();
+            delete _ordered;
+            _ordered = _next;
+        }
+    }
+
+    void
+    retain() noexcept
+    { _refs.fetch_add(1, std::memory_order_relaxed); }
+
+    void
+    release() noexcept
+    {
+        if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+private:
+    ~expiry_list()
+    {
+        while (_head) {
+            auto _next = _head->next;
+            delete _head;
+            _head = _next;
+        }
+    }
+
+    void
+    _lock() noexcept
+    { while (_locked.test_and_set(std::memory_order_acquire)) { } }
+
+    void
+    _unlock() noexcept
+    { _locked.clear(std::memory_order_release); }
+
+    std::atomic<long> _refs{1};
+    std::atomic_flag _locked = ATOMIC_FLAG_INIT;
+    bool _closed = false;
+    expiry_callback* _head = nullptr;
+    std::size_t _last_id = 0;
+};
+
+} // namespace detail
+
+// Class expiry_token, refers to a callback registered with on_expire
+
+class expiry_token {
+public:
+    /// Default constructor, refers to no callback
+    constexpr expiry_token() noexcept = default;
+
+    /// Refers to the callback id of list, taking a reference on list
+    expiry_token(detail::expiry_list* list, std::size_t id) noexcept
+    : _list{list},
+      _id{id}
+    { _list->retain(); }
+
+    expiry_token(expiry_token&& t) noexcept
+    : _list{t._list},
+      _id{t._id}
+    {
+        t._list = nullptr;
+        t._id = 0;
+    }
+
+    expiry_token&
+    operator=(expiry_token&& t) noexcept
+    {
+        if (this != &t) {
+            if (_list) _list->release();
+            _list = t._list;
+            _id = t._id;
+            t._list = nullptr;
+            t._id = 0;
+        }
+        return *this;
+    }
+
+    expiry_token(const expiry_token&) = delete;
+    expiry_token& operator=(const expiry_token&) = delete;
+
+    /// Leaves the callback registered
+    ~expiry_token()
+    { if (_list) _list->release(); }
+
+    /// Unregisters the callback; false if it has been called already, or
+    ///     is being called
+    bool
+    cancel() noexcept
+    {
+        if (!_id) return false;
+        const bool _removed = _list->remove(_id);
+        _list->release();
+        _list = nullptr;
+        _id = 0;
+        return _removed;
+    }
+
+    /// Whether the token refers to a callback, it may have been called
+    explicit operator bool() const noexcept
+    { return _id != 0; }
+
+private:
+    detail::expiry_list* _list = nullptr;
+    std::size_t _id = 0;
+};
+
+} // namespace smart_ptr
+
+#endif
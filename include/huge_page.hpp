@@ -0,0 +1,222 @@
+// huge page backed array allocation
+
+/**
+ * make_unique_huge<T[]>(n) and make_shared_huge<T[]>(n) map large arrays
+ *  straight from the kernel, aligned to huge_page_size and advised to be
+ *  backed by transparent huge pages (MADV_HUGEPAGE), which cuts the TLB
+ *  misses of random accesses to multi-GB tables. With populate set, every
+ *  page is faulted in up front instead of on first touch.
+ *
+ * The array is unmapped by huge_page_delete. Fresh mappings are zeroed,
+ *  so arrays of trivial types are not constructed element by element,
+ *  and untouched pages stay unallocated.
+ *
+ * Where mmap is not available, the array falls back to an ordinary
+ *  allocation aligned to huge_page_size.
+ */
+
+#ifndef HUGE_PAGE_HPP
+#define HUGE_PAGE_HPP 1
+
+#include <cstddef>      // size_t
+#include <cstdint>      // uintptr_t
+#include <new>          // placement new, bad_alloc, bad_array_new_length
+#include <limits>       // numeric_limits
+#include <type_traits>  // remove_extent, enable_if, is_array, extent,
+                            // is_trivially_default_constructible
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>   // mmap, munmap, madvise
+#include <unistd.h>     // sysconf
+#define SMART_PTR_HAS_MMAP 1
+#endif
+
+#include "allocate.hpp"
+#include "unique_ptr.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+/// Size of a transparent huge page on x86-64 and most arm64 kernels
+constexpr std::size_t huge_page_size = std::size_t{2} << 20;
+
+namespace detail {
+
+/// Size of a base page, as the kernel reports it
+inline std::size_t
+page_size() noexcept
+{
+#ifdef SMART_PTR_HAS_MMAP
+    static const std::size_t _size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return _size;
+#else
+    return 4096;
+#endif
+}
+
+/// Rounds bytes up to a whole number of huge pages
+constexpr std::size_t
+huge_page_round(std::size_t bytes) noexcept
+{ return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size; }
+
+/// Maps bytes of zeroed memory aligned to huge_page_size
+inline void*
+huge_page_map(std::size_t bytes, bool populate)
+{
+#ifdef SMART_PTR_HAS_MMAP
+    // Over-map by one huge page, then trim to an aligned region
+    const std::size_t _len = bytes + huge_page_size;
+    void* _raw = ::mmap(nullptr, _len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (_raw == MAP_FAILED) throw std::bad_alloc{};
+    const auto _begin = reinterpret_cast<std::uintptr_t>(_raw);
+    const auto _aligned = (_begin + huge_page_size - 1)
+                          & ~static_cast<std::uintptr_t>(huge_page_size - 1);
+    const std::size_t _head = _aligned - _begin;
+    if (_head) ::munmap(_raw, _head);
+    if (_len - _head > bytes)
+        ::munmap(reinterpret_cast<void*>(_aligned + bytes), _len - _head - bytes);
+    void* _p = reinterpret_cast<void*>(_aligned);
+
+#ifdef MADV_HUGEPAGE
+    ::madvise(_p, bytes, MADV_HUGEPAGE);
+#endif
+    // Prefault after the advice, so that the faults are served by huge pages
+    // (MAP_POPULATE at mmap time would populate with small pages first)
+    if (populate) {
+#ifdef MADV_POPULATE_WRITE
+        if (::madvise(_p, bytes, MADV_POPULATE_WRITE) != 0)
+#endif
+        {
+            auto _bytes = static_cast<volatile char*>(_p);
+            const std::size_t _step = page_size();
+            for (std::size_t _i = 0; _i < bytes; _i += _step) _bytes[_i] = 0;
+        }
+    }
+    return _p;
+#else
+    void* _p = allocate(bytes, huge_page_size);
+    char* _bytes = static_cast<char*>(_p);
+    for (std::size_t _i = 0; _i < bytes; ++_i) _bytes[_i] = 0;
+    (void)populate;
+    return _p;
+#endif
+}
+
+/// Unmaps memory obtained from huge_page_map(bytes, populate)
+inline void
+huge_page_unmap(void* p, std::size_t bytes) noexcept
+{
+#ifdef SMART_PTR_HAS_MMAP
+    ::munmap(p, bytes);
+#else
+    deallocate(p, bytes, huge_page_size);
+#endif
+}
+
+} // namespace detail
+
+// huge_page_delete, deleter for arrays created by the huge page factories
+
+template<typename T> class huge_page_delete;
+
+template<typename T>
+class huge_page_delete<T[]>
+{
+public:
+    /// Default constructor, for a unique_ptr that owns nothing
+    constexpr huge_page_delete() noexcept
+    : _n{0},
+      _bytes{0}
+    { }
+
+    /// Constructs the deleter of n elements mapped over bytes
+    huge_page_delete(std::size_t n, std::size_t bytes) noexcept
+    : _n{n},
+      _bytes{bytes}
+    { }
+
+    /// Call operator, destroys the elements and unmaps the array
+    void operator()(T* p) const
+    {
+        for (std::size_t _i = _n; _i > 0; --_i)
+            p[_i - 1].~T();
+        detail::huge_page_unmap(static_cast<void*>(p), _bytes);
+    }
+
+    /// Number of elements of the array
+    std::size_t
+    size() const noexcept
+    { return _n; }
+
+private:
+    std::size_t _n;
+    std::size_t _bytes;
+};
+
+namespace detail {
+
+/// Maps n value-initialized elements, sets bytes to the length mapped
+template<typename T>
+    T*
+    make_huge_array(std::size_t n, bool populate, std::size_t& bytes)
+    {
+        // Leave room for rounding up and for the huge page mapped over
+        if (n > (std::numeric_limits<std::size_t>::max() - 2 * huge_page_size) / sizeof(T))
+            throw std::bad_array_new_length{};
+        bytes = huge_page_round(n * sizeof(T));
+        if (bytes == 0) bytes = huge_page_size;
+        T* _p = static_cast<T*>(huge_page_map(bytes, populate));
+        if (std::is_trivially_default_constructible<T>::value)
+            return _p; // already zeroed
+        std::size_t _i = 0;
+        try {
+            for (; _i < n; ++_i)
+                ::new (static_cast<void*>(_p + _i)) T();
+        } catch (...) {
+            for (; _i > 0; --_i)
+                _p[_i - 1].~T();
+            huge_page_unmap(static_cast<void*>(_p), bytes);
+            throw;
+        }
+        return _p;
+    }
+
+} // namespace detail
+
+/// Creates a unique_ptr that manages a new huge page backed array of n
+///     elements, prefaulted if populate is set.
+///     Only for arrays with unknown bound.
+template<typename T>
+    inline typename std::enable_if<std::is_array<T>::value && !std::extent<T>::value,
+        unique_ptr<T, huge_page_delete<T>>>::type
+    make_unique_huge(std::size_t n, bool populate = false)
+    {
+        using U = typename std::remove_extent<T>::type;
+        std::size_t _bytes;
+        U* _p = detail::make_huge_array<U>(n, populate, _bytes);
+        return unique_ptr<T, huge_page_delete<T>>{_p, huge_page_delete<T>{n, _bytes}};
+    }
+
+/// Creates a shared_ptr that manages a new huge page backed array of n
+///     elements, prefaulted if populate is set.
+///     Only for arrays with unknown bound.
+template<typename T>
+    inline typename std::enable_if<std::is_array<T>::value && !std::extent<T>::value,
+        shared_ptr<T>>::type
+    make_shared_huge(std::size_t n, bool populate = false)
+    {
+        using U = typename std::remove_extent<T>::type;
+        std::size_t _bytes;
+        U* _p = detail::make_huge_array<U>(n, populate, _bytes);
+        try {
+            return shared_ptr<T>{_p, huge_page_delete<T>{n, _bytes}};
+        } catch (...) {
+            huge_page_delete<T>{n, _bytes}(_p);
+            throw;
+        }
+    }
+
+} // namespace smart_ptr
+
+#endif
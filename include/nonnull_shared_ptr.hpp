@@ -0,0 +1,247 @@
+// nonnull_shared_ptr implementation
+
+/**
+ * nonnull_shared_ptr is a shared_ptr that always manages an object. It
+ *  cannot be default-constructed, and is only created by
+ *  make_nonnull_shared or by a checked conversion from a shared_ptr, which
+ *  throws std::invalid_argument if the shared_ptr is empty.
+ *
+ * With the invariant in the type, copying and dereferencing skip the null
+ *  tests shared_ptr has to make. Moving steals the pointer and the
+ *  reference, so that a vector reallocating its elements touches no
+ *  reference count; the moved-from nonnull_shared_ptr is left in a valid
+ *  but unspecified state, and may only be destroyed or assigned to, not
+ *  dereferenced or copied. Its destructor is thus the one place that tests
+ *  for null. Moving from a shared_ptr steals its reference as well.
+ *
+ * See nonnull_shared_ptr_bench.cpp for the cost of the null tests saved.
+ */
+
+#ifndef NONNULL_SHARED_PTR_HPP
+#define NONNULL_SHARED_PTR_HPP 1
+
+#include <utility>      // forward, move, swap
+#include <stdexcept>    // invalid_argument
+#include <functional>   // hash
+
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+// Forward declarations
+
+template<typename T> class nonnull_shared_ptr;
+
+template<typename T, typename... Args>
+    nonnull_shared_ptr<T> make_nonnull_shared(Args&&... args);
+
+// Class template nonnull_shared_ptr
+
+template<typename T>
+class nonnull_shared_ptr {
+public:
+    template<typename U>
+    friend class nonnull_shared_ptr;
+
+    template<typename U, typename... Args>
+    friend nonnull_shared_ptr<U> make_nonnull_shared(Args&&... args);
+
+    using element_type = typename shared_ptr<T>::element_type;
+
+    // constructors
+
+    /// Disables default constructor: there would be no object to manage
+    nonnull_shared_ptr() = delete;
+
+    /// Checked conversion: shares ownership with sp
+    /// Throws std::invalid_argument if sp does not manage an object.
+    template<typename U>
+    explicit nonnull_shared_ptr(const shared_ptr<U>& sp)
+    : _ptr{sp.get()},
+      _control_block{detail::sp_access::get_control_block(sp)}
+    {
+        if (!_ptr || !_control_block)
+            throw std::invalid_argument{"nonnull_shared_ptr from an empty shared_ptr"};
+        _control_block->inc_ref();
+    }
+
+    /// Checked conversion: takes over the ownership held by sp, without
+    ///     touching the reference count
+    /// Throws std::invalid_argument if sp does not manage an object, in
+    ///     which case sp is left as it was.
+    template<typename U>
+    explicit nonnull_shared_ptr(shared_ptr<U>&& sp)
+    : _ptr{sp.get()},
+      _control_block{detail::sp_access::get_control_block(sp)}
+    {
+        if (!_ptr || !_control_block)
+            throw std::invalid_argument{"nonnull_shared_ptr from an empty shared_ptr"};
+        detail::sp_access::release(sp);
+    }
+
+    /// Copy constructor: shares ownership of the object managed by nsp
+    nonnull_shared_ptr(const nonnull_shared_ptr& nsp) noexcept
+    : _ptr{nsp._ptr},
+      _control_block{nsp._control_block}
+    { _control_block->inc_ref(); }
+
+    /// Copy constructor: shares ownership of the object managed by nsp
+    template<typename U>
+    nonnull_shared_ptr(const nonnull_shared_ptr<U>& nsp) noexcept
+    : _ptr{nsp._ptr},
+      _control_block{nsp._control_block}
+    { _control_block->inc_ref(); }
+
+    /// Move constructor: takes over the ownership held by nsp, which may
+    ///     then only be destroyed or assigned to
+    nonnull_shared_ptr(nonnull_shared_ptr&& nsp) noexcept
+    : _ptr{nsp._ptr},
+      _control_block{nsp._control_block}
+    {
+        nsp._ptr = nullptr;
+        nsp._control_block = nullptr;
+    }
+
+    // destructor
+
+    ~nonnull_shared_ptr()
+    { if (_control_block) _control_block->dec_ref(); } // null if moved from
+
+    // assignment
+
+    /// Copy assignment
+    nonnull_shared_ptr&
+    operator=(const nonnull_shared_ptr& nsp) noexcept
+    {
+        nonnull_shared_ptr{nsp}.swap(*this);
+        return *this;
+    }
+
+    /// Copy assignment
+    template<typename U>
+    nonnull_shared_ptr&
+    operator=(const nonnull_shared_ptr<U>& nsp) noexcept
+    {
+        nonnull_shared_ptr{nsp}.swap(*this);
+        return *this;
+    }
+
+    /// Move assignment: takes over the ownership held by nsp, which may
+    ///     then only be destroyed or assigned to
+    nonnull_shared_ptr&
+    operator=(nonnull_shared_ptr&& nsp) noexcept
+    {
+        nonnull_shared_ptr{std::move(nsp)}.swap(*this);
+        return *this;
+    }
+
+    // modifiers
+
+    /// Exchanges the contents of *this and nsp
+    void
+    swap(nonnull_shared_ptr& nsp) noexcept
+    {
+        using std::swap;
+        swap(_ptr, nsp._ptr);
+        swap(_control_block, nsp._control_block);
+    }
+
+    // observers
+
+    /// Gets the stored pointer, never null
+    element_type*
+    get() const noexcept
+    { return _ptr; }
+
+    /// Dereferences pointer to the managed object
+    element_type&
+    operator*() const noexcept
+    { return *_ptr; }
+
+    /// Dereferences pointer to the managed object
+    element_type*
+    operator->() const noexcept
+    { return _ptr; }
+
+    /// Gets use_count
+    long
+    use_count() const noexcept
+    { return _control_block->use_count(); }
+
+    /// Converts to a shared_ptr sharing ownership of the object
+    template<typename U>
+    operator shared_ptr<U>() const noexcept
+    {
+        _control_block->inc_ref();
+        return detail::sp_access::adopt<U>(_ptr, _control_block);
+    }
+
+    /// Converts to a shared_ptr sharing ownership of the object
+    shared_ptr<T>
+    to_shared() const noexcept
+    { return *this; }
+
+private:
+    /// Adopts one reference already taken on cb
+    nonnull_shared_ptr(element_type* p, detail::control_block_base* cb) noexcept
+    : _ptr{p},
+      _control_block{cb}
+    { }
+
+    element_type* _ptr;
+    detail::control_block_base* _control_block;
+};
+
+/// Creates a nonnull_shared_ptr that manages a new object
+template<typename T, typename... Args>
+    inline nonnull_shared_ptr<T>
+    make_nonnull_shared(Args&&... args)
+    {
+        auto _sp = smart_ptr::make_shared<T>(std::forward<Args>(args)...);
+        auto _p = _sp.get();
+        return nonnull_shared_ptr<T>{_p, detail::sp_access::release(_sp)};
+    }
+
+// nonnull_shared_ptr comparisons
+
+/// Operator == overloading
+template<typename T, typename U>
+    inline bool
+    operator==(const nonnull_shared_ptr<T>& nsp1,
+               const nonnull_shared_ptr<U>& nsp2) noexcept
+    { return nsp1.get() == nsp2.get(); }
+
+/// Operator != overloading
+template<typename T, typename U>
+    inline bool
+    operator!=(const nonnull_shared_ptr<T>& nsp1,
+               const nonnull_shared_ptr<U>& nsp2) noexcept
+    { return nsp1.get() != nsp2.get(); }
+
+/// Swaps with another nonnull_shared_ptr
+template<typename T>
+    inline void
+    swap(nonnull_shared_ptr<T>& nsp1, nonnull_shared_ptr<T>& nsp2) noexcept
+    { nsp1.swap(nsp2); }
+
+} // namespace smart_ptr
+
+namespace std {
+
+// Template specialization of std::hash for smart_ptr::nonnull_shared_ptr<T>
+
+template<typename T>
+struct hash<smart_ptr::nonnull_shared_ptr<T>> {
+    using result_type = std::size_t;
+    using argument_type = smart_ptr::nonnull_shared_ptr<T>;
+
+    std::size_t
+    operator()(const smart_ptr::nonnull_shared_ptr<T>& nsp) const {
+        return hash<typename smart_ptr::nonnull_shared_ptr<T>::element_type*>()(nsp.get());
+    }
+};
+
+} // namespace std
+
+#endif
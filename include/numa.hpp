@@ -0,0 +1,267 @@
+// NUMA-aware placement of shared objects
+
+/**
+ * On a multi-socket machine, a control block allocated on a remote node
+ *  turns every reference count update into a cross-socket transaction.
+ *  numa_allocator places the control block and the object, allocated
+ *  together by allocate_shared, on a given NUMA node, by default the node
+ *  the constructing thread runs on:
+ *
+ *      auto sp = make_shared_numa<Node>(args...);             // caller's node
+ *      auto sp = make_shared_on_node<Node>(1, args...);       // node 1
+ *      auto sp = allocate_shared<Node>(numa_allocator<Node>{1}, args...);
+ *
+ * Each node has its own huge_page_arena, whose regions are bound to the
+ *  node with the mbind system call (MPOL_PREFERRED, so that a full node
+ *  spills over instead of failing). The node is chosen when the allocator
+ *  is constructed and travels with it into the control block, so a block
+ *  is always freed to the arena it came from, whichever thread drops the
+ *  last reference. Objects whose block, counts included, exceeds the
+ *  arena's max_block_size are mapped and unmapped one by one, see arena.hpp.
+ *
+ * The system calls are made directly, so libnuma is not required. Where
+ *  they are not available or fail, e.g. on a kernel without NUMA support,
+ *  the machine is treated as a single node 0 and memory is left unbound.
+ *  numa_node_stats reports the allocations made for each node.
+ */
+
+#ifndef NUMA_HPP
+#define NUMA_HPP 1
+
+#include <cstddef>      // size_t
+#include <atomic>       // atomic
+#include <stdexcept>    // invalid_argument
+#include <utility>      // forward
+
+#if defined(__linux__)
+#include <unistd.h>     // syscall
+#include <sys/syscall.h> // SYS_mbind, SYS_get_mempolicy, SYS_getcpu
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy) && defined(SYS_getcpu)
+#define SMART_PTR_HAS_NUMA 1
+#endif
+#endif
+
+#include "arena.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+/// Highest number of nodes supported
+constexpr int max_numa_nodes = 64;
+
+/// Allocation statistics of a NUMA node
+struct numa_stats {
+    std::size_t allocations;
+    std::size_t deallocations;
+    std::size_t bytes_in_use;
+};
+
+namespace detail {
+
+#ifdef SMART_PTR_HAS_NUMA
+// From <linux/mempolicy.h>
+constexpr int mpol_preferred = 1;
+constexpr unsigned long mpol_f_node = 1UL << 0;
+constexpr unsigned long mpol_f_addr = 1UL << 1;
+constexpr unsigned long mpol_f_mems_allowed = 1UL << 2;
+#endif
+
+/// Sets the preferred node of the pages in [p, p + len), if possible
+inline void
+numa_bind(void* p, std::size_t len, int node) noexcept
+{
+#ifdef SMART_PTR_HAS_NUMA
+    unsigned long _mask = 1UL << node;
+    // maxnode is one past the number of mask bits the kernel reads
+    ::syscall(SYS_mbind, p, len, mpol_preferred, &_mask,
+              sizeof(_mask) * 8 + 1, 0);
+#else
+    (void)p; (void)len; (void)node;
+#endif
+}
+
+/// Per-node counters behind numa_node_stats
+struct numa_counters {
+    std::atomic<std::size_t> allocations;
+    std::atomic<std::size_t> deallocations;
+    std::atomic<std::size_t> bytes_in_use;
+};
+
+inline numa_counters*
+numa_counter_table() noexcept
+{
+    static numa_counters _table[max_numa_nodes] = {};
+    return _table;
+}
+
+} // namespace detail
+
+/// Number of NUMA nodes the process may allocate on, 1 if unknown
+inline int
+numa_node_count() noexcept
+{
+    static const int _count = [] {
+#ifdef SMART_PTR_HAS_NUMA
+        unsigned long _mask = 0;
+        if (::syscall(SYS_get_mempolicy, nullptr, &_mask, sizeof(_mask) * 8 + 1,
+                      nullptr, detail::mpol_f_mems_allowed) == 0 && _mask) {
+            int _n = 0;
+            for (; _n < max_numa_nodes && (_mask >> _n); ++_n) { }
+            return _n;
+        }
+#endif
+        return 1;
+    }();
+    return _count;
+}
+
+/// Node the calling thread currently runs on, 0 if unknown
+inline int
+numa_current_node() noexcept
+{
+#ifdef SMART_PTR_HAS_NUMA
+    unsigned _cpu = 0, _node = 0;
+    if (::syscall(SYS_getcpu, &_cpu, &_node, nullptr) == 0
+        && static_cast<int>(_node) < numa_node_count())
+        return static_cast<int>(_node);
+#endif
+    return 0;
+}
+
+/// Node the page holding p resides on, -1 if unknown or not yet faulted in
+inline int
+numa_node_of(const void* p) noexcept
+{
+#ifdef SMART_PTR_HAS_NUMA
+    int _node = -1;
+    if (::syscall(SYS_get_mempolicy, &_node, nullptr, 0, const_cast<void*>(p),
+                  detail::mpol_f_node | detail::mpol_f_addr) == 0)
+        return _node;
+#else
+    (void)p;
+#endif
+    return -1;
+}
+
+/// Snapshot of the allocation statistics of node
+inline numa_stats
+numa_node_stats(int node)
+{
+    if (node < 0 || node >= max_numa_nodes)
+        throw std::invalid_argument{"NUMA node out of range"};
+    auto& _c = detail::numa_counter_table()[node];
+    return numa_stats{_c.allocations.load(std::memory_order_relaxed),
+                      _c.deallocations.load(std::memory_order_relaxed),
+                      _c.bytes_in_use.load(std::memory_order_relaxed)};
+}
+
+/// Arena whose memory is bound to node, which is never destroyed
+inline huge_page_arena&
+numa_arena(int node)
+{
+    if (node < 0 || node >= numa_node_count())
+        throw std::invalid_argument{"NUMA node out of range"};
+    static std::atomic<huge_page_arena*> _arenas[max_numa_nodes] = {};
+    auto _a = _arenas[node].load(std::memory_order_acquire);
+    if (!_a) {
+        auto _fresh = new huge_page_arena{[node](void* p, std::size_t len) {
+            detail::numa_bind(p, len, node);
+        }};
+        if (_arenas[node].compare_exchange_strong(_a, _fresh, std::memory_order_acq_rel))
+            _a = _fresh;
+        else
+            delete _fresh;
+    }
+    return *_a;
+}
+
+// Class template numa_allocator, allocator placing memory on a NUMA node
+
+template<typename T>
+class numa_allocator {
+public:
+    template<typename U>
+    friend class numa_allocator;
+
+    using value_type = T;
+
+    /// Allocates on the node the calling thread runs on
+    numa_allocator() noexcept
+    : _node{numa_current_node()}
+    { }
+
+    /// Allocates on node
+    /// Throws std::invalid_argument if there is no such node.
+    explicit numa_allocator(int node)
+    : _node{node}
+    { numa_arena(node); }
+
+    /// Converting constructor, allocates on the same node
+    template<typename U>
+    numa_allocator(const numa_allocator<U>& a) noexcept
+    : _node{a._node}
+    { }
+
+    T*
+    allocate(std::size_t n)
+    {
+        const std::size_t _bytes = n * sizeof(T);
+        T* _p = static_cast<T*>(numa_arena(_node).allocate(_bytes, alignof(T)));
+        auto& _c = detail::numa_counter_table()[_node];
+        _c.allocations.fetch_add(1, std::memory_order_relaxed);
+        _c.bytes_in_use.fetch_add(_bytes, std::memory_order_relaxed);
+        return _p;
+    }
+
+    void
+    deallocate(T* p, std::size_t n) noexcept
+    {
+        const std::size_t _bytes = n * sizeof(T);
+        numa_arena(_node).deallocate(p, _bytes, alignof(T));
+        auto& _c = detail::numa_counter_table()[_node];
+        _c.deallocations.fetch_add(1, std::memory_order_relaxed);
+        _c.bytes_in_use.fetch_sub(_bytes, std::memory_order_relaxed);
+    }
+
+    /// Gets the node allocated on
+    int
+    node() const noexcept
+    { return _node; }
+
+private:
+    int _node;
+};
+
+template<typename T, typename U>
+    inline bool
+    operator==(const numa_allocator<T>& a1, const numa_allocator<U>& a2) noexcept
+    { return a1.node() == a2.node(); }
+
+template<typename T, typename U>
+    inline bool
+    operator!=(const numa_allocator<T>& a1, const numa_allocator<U>& a2) noexcept
+    { return !(a1 == a2); }
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block on the node the calling thread runs on
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_numa(Args&&... args)
+    {
+        return smart_ptr::allocate_shared<T>(numa_allocator<T>{},
+                                             std::forward<Args>(args)...);
+    }
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block on node
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_on_node(int node, Args&&... args)
+    {
+        return smart_ptr::allocate_shared<T>(numa_allocator<T>{node},
+                                             std::forward<Args>(args)...);
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,369 @@
+// recycling object pool
+
+/**
+ * An object_pool<T> keeps idle objects that are expensive to construct,
+ *  like large buffers or parsers, and hands them out again instead of
+ *  constructing new ones:
+ *
+ *      object_pool<Parser> pool{64, [](Parser& p) { p.clear(); }};
+ *      auto up = pool.acquire();           // unique_ptr<Parser, pool_deleter<Parser>>
+ *      auto sp = pool.acquire_shared();    // shared_ptr<Parser>
+ *
+ * The pool_deleter of an acquired object calls the reset hook on it and
+ *  returns it to the pool instead of destroying it. An object acquired while
+ *  the pool is empty is created by the factory hook, or by new T().
+ *
+ * Idle objects are kept on a lock-free free list of capacity slots, and on
+ *  top of it in a small cache per thread, of up to thread_cache_size
+ *  objects (and no more than capacity), that is visited first. An object
+ *  returned while both are full is destroyed.
+ *
+ * A pool must outlive the objects acquired from it. Objects left in the
+ *  cache of another thread when the pool is destroyed are destroyed by
+ *  that thread, on its next use of a pool of the same type or on its exit.
+ *  Objects must be created with new, as they are destroyed with delete.
+ */
+
+#ifndef OBJECT_POOL_HPP
+#define OBJECT_POOL_HPP 1
+
+#include <cstddef>      // size_t
+#include <cstdint>      // uint32_t, uint64_t
+#include <atomic>       // atomic
+#include <vector>       // vector
+#include <utility>      // move, swap
+#include <functional>   // function
+
+#include "unique_ptr.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+template<typename T> class object_pool;
+
+// Class template pool_deleter, returns objects to their object_pool
+
+template<typename T>
+class pool_deleter {
+public:
+    /// Default constructor, deletes the objects instead
+    constexpr pool_deleter() noexcept = default;
+
+    /// Constructs the deleter of objects acquired from pool
+    explicit pool_deleter(object_pool<T>* pool) noexcept
+    : _pool{pool}
+    { }
+
+    /// Call operator, returns the object to the pool
+    void operator()(T* p) const
+    {
+        if (_pool) _pool->_release(p);
+        else delete p;
+    }
+
+    /// Gets the pool objects are returned to
+    object_pool<T>*
+    pool() const noexcept
+    { return _pool; }
+
+private:
+    object_pool<T>* _pool = nullptr;
+};
+
+// Class template object_pool
+
+template<typename T>
+class object_pool {
+    friend class pool_deleter<T>;
+
+public:
+    /// Called on each object returned to the pool, must not throw
+    using reset_hook = std::function<void(T&)>;
+
+    /// Called to create an object when the pool is empty, its result is
+    ///     destroyed with delete
+    using factory = std::function<T*()>;
+
+    /// Maximum number of idle objects cached by each thread
+    static constexpr std::size_t thread_cache_size = 8;
+
+    /// Constructs a pool keeping up to capacity idle objects
+    explicit object_pool(std::size_t capacity,
+                         reset_hook on_release = nullptr,
+                         factory make = nullptr)
+    : _state{new _State{capacity, std::move(on_release), std::move(make)}}
+    { }
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    /// Destroys the idle objects not cached by another thread
+    ~object_pool()
+    {
+        _state->closed.store(true, std::memory_order_relaxed);
+        _drop_local();
+        while (T* _p = _state->get()) delete _p;
+    }
+
+    /// Gets an idle object, or creates one if there is none
+    unique_ptr<T, pool_deleter<T>>
+    acquire()
+    {
+        T* _p = nullptr;
+        auto _c = _local();
+        if (_c && _c->n) _p = _c->objs[--_c->n];
+        else _p = _state->get();
+
+        if (_p) {
+            _state->hits.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            _state->misses.fetch_add(1, std::memory_order_relaxed);
+            _p = _state->make ? _state->make() : new T();
+        }
+        return unique_ptr<T, pool_deleter<T>>{_p, pool_deleter<T>{this}};
+    }
+
+    /// Gets an idle object, or creates one if there is none, shared
+    shared_ptr<T>
+    acquire_shared()
+    { return shared_ptr<T>{acquire()}; }
+
+    /// Maximum number of idle objects kept on the shared free list
+    std::size_t
+    capacity() const noexcept
+    { return _state->capacity; }
+
+    /// Number of acquisitions that got an idle object
+    std::size_t
+    hits() const noexcept
+    { return _state->hits.load(std::memory_order_relaxed); }
+
+    /// Number of acquisitions that had to create an object
+    std::size_t
+    misses() const noexcept
+    { return _state->misses.load(std::memory_order_relaxed); }
+
+private:
+    struct _Slot {
+        T* obj;
+        std::atomic<std::uint32_t> next;
+    };
+
+    /// Lock-free stack of slots, linked by 1-based index; the head carries
+    ///     a tag bumped on every update against ABA
+    class _Stack {
+    public:
+        void
+        push(_Slot* slots, std::uint32_t i) noexcept
+        {
+            auto _h = _head.load(std::memory_order_relaxed);
+            do {
+                slots[i - 1].next.store(static_cast<std::uint32_t>(_h),
+                                        std::memory_order_relaxed);
+            } while (!_head.compare_exchange_weak(_h, _retag(_h, i),
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+        }
+
+        /// Returns the index popped, 0 if empty
+        std::uint32_t
+        pop(_Slot* slots) noexcept
+        {
+            auto _h = _head.load(std::memory_order_acquire);
+            for (;;) {
+                const auto _i = static_cast<std::uint32_t>(_h);
+                if (!_i) return 0;
+                const auto _n = slots[_i - 1].next.load(std::memory_order_relaxed);
+                if (_head.compare_exchange_weak(_h, _retag(_h, _n),
+                                                std::memory_order_acquire,
+                                                std::memory_order_acquire))
+                    return _i;
+            }
+        }
+
+    private:
+        static std::uint64_t
+        _retag(std::uint64_t h, std::uint32_t i) noexcept
+        { return (((h >> 32) + 1) << 32) | i; }
+
+        std::atomic<std::uint64_t> _head{0};
+    };
+
+    /// State shared with the thread caches, which may outlive the pool
+    struct _State {
+        _State(std::size_t cap, reset_hook on_release, factory f)
+        : slots{make_unique<_Slot[]>(cap)},
+          capacity{cap},
+          cache_limit{cap < thread_cache_size ? cap : thread_cache_size},
+          reset{std::move(on_release)},
+          make{std::move(f)}
+        {
+            for (std::size_t _i = cap; _i > 0; --_i)
+                empty.push(slots.get(), static_cast<std::uint32_t>(_i));
+        }
+
+        ~_State()
+        { while (T* _p = get()) delete _p; }
+
+        /// Takes an idle object from the free list, nullptr if there is none
+        T*
+        get() noexcept
+        {
+            const auto _i = full.pop(slots.get());
+            if (!_i) return nullptr;
+            T* _p = slots[_i - 1].obj;
+            empty.push(slots.get(), _i);
+            return _p;
+        }
+
+        /// Puts p on the free list, false if it is full
+        bool
+        put(T* p) noexcept
+        {
+            const auto _i = empty.pop(slots.get());
+            if (!_i) return false;
+            slots[_i - 1].obj = p;
+            full.push(slots.get(), _i);
+            return true;
+        }
+
+        unique_ptr<_Slot[]> slots;
+        _Stack full;
+        _Stack empty;
+        const std::size_t capacity;
+        const std::size_t cache_limit;
+        const reset_hook reset;
+        const factory make;
+        std::atomic<bool> closed{false};
+        std::atomic<std::size_t> hits{0};
+        std::atomic<std::size_t> misses{0};
+    };
+
+    /// Idle objects of one pool cached by one thread
+    struct _Cache {
+        explicit _Cache(const shared_ptr<_State>& s) noexcept
+        : state{s}
+        { }
+
+        _Cache(_Cache&& c) noexcept
+        : state{std::move(c.state)},
+          n{c.n}
+        {
+            for (std::size_t _i = 0; _i < n; ++_i) objs[_i] = c.objs[_i];
+            c.n = 0;
+        }
+
+        _Cache&
+        operator=(_Cache&& c) noexcept
+        {
+            if (this != &c) {
+                flush();
+                state = std::move(c.state);
+                n = c.n;
+                for (std::size_t _i = 0; _i < n; ++_i) objs[_i] = c.objs[_i];
+                c.n = 0;
+            }
+            return *this;
+        }
+
+        ~_Cache()
+        { flush(); }
+
+        /// Hands the objects back to the free list, or destroys them if
+        ///     it is full or the pool is gone
+        void
+        flush() noexcept
+        {
+            while (n) {
+                T* _p = objs[--n];
+                if (state->closed.load(std::memory_order_relaxed) || !state->put(_p))
+                    delete _p;
+            }
+        }
+
+        shared_ptr<_State> state;
+        T* objs[thread_cache_size];
+        std::size_t n = 0;
+    };
+
+    /// The caches of the calling thread, one per live pool of type T
+    struct _Caches {
+        ~_Caches()
+        { _exited() = true; }
+
+        std::vector<_Cache> caches;
+    };
+
+    static _Caches&
+    _thread_caches()
+    {
+        static thread_local _Caches _c;
+        return _c;
+    }
+
+    /// Whether the calling thread has destroyed its caches, on exit
+    static bool&
+    _exited()
+    {
+        static thread_local bool _e = false;
+        return _e;
+    }
+
+    /// Gets the calling thread's cache for this pool, dropping caches of
+    ///     pools destroyed meanwhile; nullptr if there is none
+    _Cache*
+    _local()
+    {
+        if (_state->cache_limit == 0 || _exited()) return nullptr;
+        auto& _v = _thread_caches().caches;
+        for (std::size_t _i = 0; _i < _v.size(); ) {
+            if (_v[_i].state.get() == _state.get()) return &_v[_i];
+            if (_v[_i].state->closed.load(std::memory_order_relaxed)) {
+                std::swap(_v[_i], _v.back());
+                _v.pop_back();
+                continue;
+            }
+            ++_i;
+        }
+        _v.emplace_back(_state);
+        return &_v.back();
+    }
+
+    /// Destroys the calling thread's cache for this pool, and the objects
+    ///     in it, the pool being closed
+    void
+    _drop_local() noexcept
+    {
+        if (_exited()) return;
+        auto& _v = _thread_caches().caches;
+        for (std::size_t _i = 0; _i < _v.size(); ++_i) {
+            if (_v[_i].state.get() == _state.get()) {
+                std::swap(_v[_i], _v.back());
+                _v.pop_back();
+                return;
+            }
+        }
+    }
+
+    /// Resets p and keeps it, or destroys it if the pool is full
+    void
+    _release(T* p)
+    {
+        if (_state->reset) _state->reset(*p);
+        auto _c = _local();
+        if (_c && _c->n < _state->cache_limit) {
+            _c->objs[_c->n++] = p;
+            return;
+        }
+        if (!_state->put(p)) delete p;
+    }
+
+    shared_ptr<_State> _state;
+};
+
+template<typename T>
+constexpr std::size_t object_pool<T>::thread_cache_size;
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,187 @@
+// out_ptr and inout_ptr implementation
+
+/**
+ * C APIs hand resources back through T** out-parameters:
+ *
+ *      int foo_create(foo** out);
+ *      int foo_reopen(foo** inout);    // frees *inout, stores a new one
+ *
+ * out_ptr(s, args...) and inout_ptr(s, args...) create temporaries that
+ *  convert to T** (and void**). When the temporary is destroyed at the end
+ *  of the full expression, the pointer the C function stored is handed to
+ *  the smart pointer s, as if by s.reset(p, args...). Extra args, like the
+ *  deleter a shared_ptr needs, are passed along.
+ *
+ *      unique_ptr<foo, foo_deleter> up;
+ *      foo_create(out_ptr(up));
+ *
+ * inout_ptr also passes the pointer currently owned in, and gives up
+ *  ownership of it, since the C function takes care of it. It cannot be
+ *  used with shared_ptr, which is unable to give up ownership.
+ */
+
+#ifndef OUT_PTR_HPP
+#define OUT_PTR_HPP 1
+
+#include <cstddef>      // size_t
+#include <tuple>        // tuple, get(tuple)
+#include <utility>      // move, forward
+#include <memory>       // addressof
+#include <type_traits>  // enable_if, conditional, is_same, is_void
+
+#include "unique_ptr.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+namespace detail {
+
+// Compile-time integer sequence, for unpacking the stored arguments
+
+template<std::size_t... Is> struct index_sequence { };
+
+template<std::size_t N, std::size_t... Is>
+struct make_index_sequence : make_index_sequence<N - 1, N - 1, Is...> { };
+
+template<std::size_t... Is>
+struct make_index_sequence<0, Is...> : index_sequence<Is...> { };
+
+// Raw pointer type managed by a smart pointer
+
+template<typename Smart>
+struct pointer_of {
+    using type = typename Smart::pointer;
+};
+
+template<typename T>
+struct pointer_of<shared_ptr<T>> {
+    using type = typename shared_ptr<T>::element_type*;
+};
+
+template<typename Smart>
+struct is_shared_ptr : std::false_type { };
+
+template<typename T>
+struct is_shared_ptr<shared_ptr<T>> : std::true_type { };
+
+// Common part of out_ptr_t and inout_ptr_t: holds the smart pointer, the
+//  raw pointer filled in by the C function, and the arguments to reset with
+
+template<typename Smart, typename Pointer, typename... Args>
+class out_ptr_base {
+public:
+    out_ptr_base(Smart& s, Pointer p, Args&&... args)
+    : _smart{std::addressof(s)},
+      _ptr{p},
+      _args{std::forward<Args>(args)...}
+    { }
+
+    out_ptr_base(out_ptr_base&& o) noexcept
+    : _smart{o._smart},
+      _ptr{o._ptr},
+      _args{std::move(o._args)}
+    { o._smart = nullptr; }
+
+    out_ptr_base(const out_ptr_base&) = delete;
+    out_ptr_base& operator=(const out_ptr_base&) = delete;
+
+    /// Converts to the out-parameter
+    operator Pointer*() noexcept
+    { return std::addressof(_ptr); }
+
+    /// Converts to a void** out-parameter
+    template<typename P = Pointer,
+             typename = typename std::enable_if<!std::is_same<P, void*>::value>::type>
+    operator void**() noexcept
+    { return reinterpret_cast<void**>(std::addressof(_ptr)); }
+
+protected:
+    /// Hands the pointer filled in to the smart pointer, if any
+    void
+    _reset()
+    {
+        if (_smart && _ptr)
+            _reset(make_index_sequence<sizeof...(Args)>{});
+    }
+
+    Smart* _smart;
+    Pointer _ptr;
+
+private:
+    using _Sp = typename pointer_of<Smart>::type;
+
+    template<std::size_t... Is>
+    void
+    _reset(index_sequence<Is...>)
+    {
+        *_smart = Smart(static_cast<_Sp>(_ptr),
+                        std::forward<Args>(std::get<Is>(_args))...);
+    }
+
+    std::tuple<Args&&...> _args;
+};
+
+} // namespace detail
+
+// out_ptr_t: resets the smart pointer with the pointer filled in
+
+template<typename Smart, typename Pointer, typename... Args>
+class out_ptr_t : public detail::out_ptr_base<Smart, Pointer, Args...> {
+public:
+    static_assert(!detail::is_shared_ptr<Smart>::value || sizeof...(Args) > 0,
+        "out_ptr into a shared_ptr needs the deleter to reset it with");
+
+    out_ptr_t(Smart& s, Args&&... args)
+    : detail::out_ptr_base<Smart, Pointer, Args...>{
+        s, Pointer{}, std::forward<Args>(args)...}
+    { }
+
+    out_ptr_t(out_ptr_t&&) = default;
+
+    ~out_ptr_t()
+    { this->_reset(); }
+};
+
+// inout_ptr_t: passes the owned pointer in, resets with the one filled in
+
+template<typename Smart, typename Pointer, typename... Args>
+class inout_ptr_t : public detail::out_ptr_base<Smart, Pointer, Args...> {
+public:
+    static_assert(!detail::is_shared_ptr<Smart>::value,
+        "inout_ptr cannot be used with shared_ptr, which cannot release ownership");
+
+    inout_ptr_t(Smart& s, Args&&... args)
+    : detail::out_ptr_base<Smart, Pointer, Args...>{
+        s, static_cast<Pointer>(s.get()), std::forward<Args>(args)...}
+    { }
+
+    inout_ptr_t(inout_ptr_t&&) = default;
+
+    ~inout_ptr_t()
+    {
+        if (this->_smart) {
+            this->_smart->release(); // the C function took care of it
+            this->_reset();
+        }
+    }
+};
+
+/// Creates an out-parameter adaptor for s
+template<typename Pointer = void, typename Smart, typename... Args>
+    inline out_ptr_t<Smart,
+        typename std::conditional<std::is_void<Pointer>::value,
+            typename detail::pointer_of<Smart>::type, Pointer>::type, Args...>
+    out_ptr(Smart& s, Args&&... args)
+    { return {s, std::forward<Args>(args)...}; }
+
+/// Creates an in/out-parameter adaptor for s
+template<typename Pointer = void, typename Smart, typename... Args>
+    inline inout_ptr_t<Smart,
+        typename std::conditional<std::is_void<Pointer>::value,
+            typename detail::pointer_of<Smart>::type, Pointer>::type, Args...>
+    inout_ptr(Smart& s, Args&&... args)
+    { return {s, std::forward<Args>(args)...}; }
+
+} // namespace smart_ptr
+
+#endif
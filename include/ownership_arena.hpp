@@ -0,0 +1,197 @@
+// per-request arena ownership with bulk release
+
+/**
+ * An ownership_arena hands out shared_ptrs whose control blocks and
+ *  objects are bump-allocated from chunks it owns:
+ *
+ *      {
+ *          ownership_arena arena;
+ *          auto sp = arena.make_shared<Node>(args...);
+ *          ...
+ *      }   // all chunks freed at once
+ *
+ * Reference counting works as usual, and an object is destroyed as soon
+ *  as its last shared_ptr goes. Its memory, however, is never freed on its
+ *  own: the arena frees all chunks at once when it is destroyed, which
+ *  saves a free per object.
+ *
+ * An arena must outlive the shared_ptrs and weak_ptrs it handed out. Those
+ *  that do not have escaped: the arena's destructor finds them, frees only
+ *  the chunks holding none of them, leaking the others so that the escaped
+ *  blocks stay valid, and reports the number of escaped blocks to the
+ *  escape handler. The default handler prints that number to stderr, in
+ *  release builds too, since the chunks kept are leaked, then asserts that
+ *  there are none. escaped() counts them beforehand.
+ *
+ * An arena is meant to be used by one thread at a time. The shared_ptrs it
+ *  hands out may be copied and dropped on any thread.
+ */
+
+#ifndef OWNERSHIP_ARENA_HPP
+#define OWNERSHIP_ARENA_HPP 1
+
+#include <cstddef>      // size_t, max_align_t
+#include <cstdint>      // uintptr_t
+#include <cstdio>       // fprintf, stderr
+#include <cassert>      // assert
+#include <new>          // placement new
+#include <utility>      // forward
+
+#include "allocate.hpp"
+#include "control_block.hpp"
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+namespace detail {
+
+/// Default escape handler, reports escaped blocks and asserts there are none
+inline void
+report_escapes(std::size_t escaped)
+{
+    std::fprintf(stderr, "ownership_arena: %zu blocks outlived the arena, "
+                 "their chunks are leaked\n", escaped);
+    assert(escaped == 0 && "shared_ptr or weak_ptr outlived its ownership_arena");
+}
+
+} // namespace detail
+
+// Class ownership_arena
+
+class ownership_arena {
+public:
+    /// Called with the number of escaped blocks by the destructor
+    using escape_handler = void (*)(std::size_t escaped);
+
+    /// Size of the chunks blocks are carved from; larger blocks get a chunk
+    ///     of their own
+    static constexpr std::size_t chunk_size = std::size_t{64} << 10;
+
+    explicit ownership_arena(escape_handler on_escape = &detail::report_escapes) noexcept
+    : _on_escape{on_escape}
+    { }
+
+    ownership_arena(const ownership_arena&) = delete;
+    ownership_arena& operator=(const ownership_arena&) = delete;
+
+    /// Frees all chunks but those holding escaped blocks
+    ~ownership_arena()
+    {
+        // Mark the chunks to keep before freeing any, as the list of
+        //     blocks runs through all of them
+        std::size_t _escaped = 0;
+        for (auto _b = _blocks; _b; _b = _b->next) {
+            if (_b->released()) continue;
+            ++_escaped;
+            for (auto _c = _chunks; _c; _c = _c->next) {
+                if (_holds(_c, _b)) {
+                    _c->keep = true;
+                    break;
+                }
+            }
+        }
+        while (_chunks) {
+            auto _c = _chunks;
+            _chunks = _c->next;
+            if (!_c->keep)
+                detail::deallocate(static_cast<void*>(_c), _c->size, _c->align);
+        }
+        if (_escaped && _on_escape) _on_escape(_escaped);
+    }
+
+    /// Creates a shared_ptr that manages a new object, allocated together
+    ///     with its control block from the arena
+    template<typename T, typename... Args>
+    shared_ptr<T>
+    make_shared(Args&&... args)
+    {
+        using _Block = detail::arena_control_block<T>;
+        void* _mem = _allocate(sizeof(_Block), alignof(_Block));
+        auto _cb = ::new (_mem) _Block{std::forward<Args>(args)...};
+        _cb->next = _blocks;
+        _blocks = _cb;
+        ++_size;
+        return detail::sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+    /// Number of objects created so far
+    std::size_t
+    size() const noexcept
+    { return _size; }
+
+    /// Number of blocks still referenced by a shared_ptr or weak_ptr
+    std::size_t
+    escaped() const noexcept
+    {
+        std::size_t _n = 0;
+        for (auto _b = _blocks; _b; _b = _b->next)
+            if (!_b->released()) ++_n;
+        return _n;
+    }
+
+private:
+    struct _Chunk {
+        _Chunk* next;
+        std::size_t size;
+        std::size_t align;
+        bool keep;              // holds an escaped block
+    };
+
+    /// Whether block b was carved from chunk c
+    static bool
+    _holds(const _Chunk* c, const void* b) noexcept
+    {
+        const auto _begin = reinterpret_cast<std::uintptr_t>(c);
+        const auto _addr = reinterpret_cast<std::uintptr_t>(b);
+        return _addr >= _begin && _addr - _begin < c->size;
+    }
+
+    /// Bump-allocates size bytes aligned to align
+    void*
+    _allocate(std::size_t size, std::size_t align)
+    {
+        auto _p = _align_up(_cur, align);
+        if (!_cur || _p > _end || static_cast<std::size_t>(_end - _p) < size) {
+            _grow(size, align);
+            _p = _align_up(_cur, align);
+        }
+        _cur = _p + size;
+        return _p;
+    }
+
+    /// Allocates a new chunk large enough for size bytes aligned to align
+    void
+    _grow(std::size_t size, std::size_t align)
+    {
+        const std::size_t _align = (align > alignof(std::max_align_t))
+            ? align : alignof(std::max_align_t);
+        std::size_t _bytes = sizeof(_Chunk) + _align + size;
+        if (_bytes < chunk_size) _bytes = chunk_size;
+        auto _c = static_cast<_Chunk*>(detail::allocate(_bytes, _align));
+        _c->next = _chunks;
+        _c->size = _bytes;
+        _c->align = _align;
+        _c->keep = false;
+        _chunks = _c;
+        _cur = reinterpret_cast<char*>(_c + 1);
+        _end = reinterpret_cast<char*>(_c) + _bytes;
+    }
+
+    static char*
+    _align_up(char* p, std::size_t align) noexcept
+    {
+        const auto _addr = reinterpret_cast<std::uintptr_t>(p);
+        return p + ((align - _addr % align) % align);
+    }
+
+    _Chunk* _chunks = nullptr;
+    char* _cur = nullptr;
+    char* _end = nullptr;
+    detail::arena_block_base* _blocks = nullptr;
+    std::size_t _size = 0;
+    escape_handler _on_escape;
+};
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,59 @@
+// polymorphic memory resource support
+
+/**
+ * make_shared_pmr, and allocate_unique with a polymorphic_allocator,
+ *  allocate from a std::pmr::memory_resource instead of global new, e.g.
+ *  from a monotonic_buffer_resource set up for one request:
+ *
+ *      std::pmr::monotonic_buffer_resource mr;
+ *      auto sp = make_shared_pmr<Node>(&mr, args...);
+ *      auto up = allocate_unique<Node>(std::pmr::polymorphic_allocator<Node>{&mr},
+ *                                      args...);
+ *
+ * make_shared_pmr allocates the control block and the object together with
+ *  a polymorphic_allocator, which the control block keeps, so it frees its
+ *  memory to the resource it came from. allocate_unique's deleter keeps the
+ *  allocator likewise. Objects are constructed uses-allocator style, so
+ *  e.g. a std::pmr::string allocates from the same resource.
+ *
+ * The resource must outlive the objects. With a monotonic resource,
+ *  deallocation is a no-op and the whole request's memory goes at once
+ *  with the resource; the objects must still be destroyed first.
+ *
+ * Requires C++17 and <memory_resource>; this header is empty otherwise.
+ */
+
+#ifndef PMR_HPP
+#define PMR_HPP 1
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && __cplusplus >= 201703L
+#define SMART_PTR_HAS_PMR 1
+#endif
+#endif
+
+#ifdef SMART_PTR_HAS_PMR
+
+#include <memory_resource> // memory_resource, polymorphic_allocator
+#include <type_traits>  // enable_if, is_array
+#include <utility>      // forward
+
+#include "shared_ptr.hpp"
+
+namespace smart_ptr {
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block from mr. Only for non-array types.
+template<typename T, typename... Args>
+    inline typename std::enable_if<!std::is_array<T>::value, shared_ptr<T>>::type
+    make_shared_pmr(std::pmr::memory_resource* mr, Args&&... args)
+    {
+        return smart_ptr::allocate_shared<T>(std::pmr::polymorphic_allocator<T>{mr},
+                                             std::forward<Args>(args)...);
+    }
+
+} // namespace smart_ptr
+
+#endif // SMART_PTR_HAS_PMR
+
+#endif
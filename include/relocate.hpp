@@ -0,0 +1,91 @@
+// trivial relocation support
+
+/**
+ * Relocating an object means move-constructing it into new storage and
+ *  destroying the source. For types whose state is nothing but raw pointers,
+ *  like shared_ptr and weak_ptr, this is exactly a memcpy followed by
+ *  forgetting the source: nulling the source out and running a destructor
+ *  that then branches on a null pointer is wasted work.
+ *
+ * is_trivially_relocatable marks such types, and uninitialized_relocate
+ *  uses it to relocate a whole range with a single memcpy, which is what
+ *  a container wants when it grows its buffer.
+ */
+
+#ifndef RELOCATE_HPP
+#define RELOCATE_HPP 1
+
+#include <cstddef>      // size_t
+#include <cstring>      // memcpy
+#include <new>          // placement new
+#include <utility>      // move
+#include <type_traits>  // integral_constant, is_trivially_copyable, is_empty
+
+#include "unique_ptr.hpp"
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+
+namespace smart_ptr {
+
+// Trait: T may be relocated with memcpy
+
+/// Trivially copyable types are trivially relocatable
+template<typename T>
+struct is_trivially_relocatable
+    : std::integral_constant<bool, std::is_trivially_copyable<T>::value> { };
+
+/// shared_ptr holds a pointer to the object and a pointer to the control block
+template<typename T>
+struct is_trivially_relocatable<shared_ptr<T>> : std::true_type { };
+
+/// weak_ptr holds a pointer to the object and a pointer to the control block
+template<typename T>
+struct is_trivially_relocatable<weak_ptr<T>> : std::true_type { };
+
+/// unique_ptr is trivially relocatable if its deleter is stateless,
+///     or trivially relocatable itself
+template<typename T, typename D>
+struct is_trivially_relocatable<unique_ptr<T, D>>
+    : std::integral_constant<bool, std::is_empty<D>::value ||
+                                   is_trivially_relocatable<D>::value> { };
+
+namespace detail {
+
+template<typename T>
+    inline T*
+    uninitialized_relocate(T* first, T* last, T* d_first, std::true_type) noexcept
+    {
+        const std::size_t _n = last - first;
+        if (_n) std::memcpy(static_cast<void*>(d_first),
+                            static_cast<const void*>(first), _n * sizeof(T));
+        return d_first + _n;
+    }
+
+template<typename T>
+    inline T*
+    uninitialized_relocate(T* first, T* last, T* d_first, std::false_type)
+    {
+        for (; first != last; ++first, ++d_first) {
+            ::new (static_cast<void*>(d_first)) T(std::move(*first));
+            first->~T();
+        }
+        return d_first;
+    }
+
+} // namespace detail
+
+/// Relocates [first, last) into the uninitialized storage starting at
+///     d_first. The source elements are left destroyed: their storage may be
+///     freed or reused without running destructors.
+/// Returns the pointer past the last element relocated.
+template<typename T>
+    inline T*
+    uninitialized_relocate(T* first, T* last, T* d_first)
+    {
+        return detail::uninitialized_relocate(first, last, d_first,
+            std::integral_constant<bool, is_trivially_relocatable<T>::value>{});
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -0,0 +1,265 @@
+// retain_ptr implementation
+
+/**
+ * retain_ptr is a smart pointer to an object that keeps its own reference
+ *  count, like the handles of many C libraries (foo_ref/foo_unref). Instead
+ *  of allocating a control block, retain_ptr calls the object's own
+ *  increment and decrement operations through a traits class, so it is the
+ *  size of a raw pointer and wrapping an object allocates nothing.
+ *
+ * The traits class provides two static functions:
+ *
+ *      static void increment(T* p) noexcept;   // take a reference on p
+ *      static void decrement(T* p) noexcept;   // drop a reference on p
+ *
+ * The default traits forward to retain_ptr_add_ref(p) and
+ *  retain_ptr_release(p), found by argument-dependent lookup.
+ */
+
+#ifndef RETAIN_PTR_HPP
+#define RETAIN_PTR_HPP 1
+
+#include <cstddef>      // nullptr_t, size_t
+#include <cassert>      // assert
+#include <utility>      // move, swap
+#include <type_traits>  // common_type
+#include <functional>   // less, hash
+
+namespace smart_ptr {
+
+// Tags telling retain_ptr whether to take a new reference on the object
+
+/// Takes a new reference: the caller keeps its own
+struct retain_object_t { constexpr retain_object_t() noexcept = default; };
+constexpr retain_object_t retain_object{};
+
+/// Adopts a reference the caller already holds, e.g. one returned by a
+///     C library's create function
+struct adopt_object_t { constexpr adopt_object_t() noexcept = default; };
+constexpr adopt_object_t adopt_object{};
+
+// Default traits, calling retain_ptr_add_ref and retain_ptr_release
+
+template<typename T>
+struct retain_traits {
+    static void
+    increment(T* p) noexcept
+    { retain_ptr_add_ref(p); }
+
+    static void
+    decrement(T* p) noexcept
+    { retain_ptr_release(p); }
+};
+
+// Class template retain_ptr
+
+template<typename T, typename R = retain_traits<T>>
+class retain_ptr {
+public:
+    using pointer = T*;
+    using element_type = T;
+    using traits_type = R;
+
+    // constructors
+
+    /// Default constructor, creates a retain_ptr that refers to nothing
+    constexpr retain_ptr() noexcept
+    : _ptr{}
+    { }
+
+    /// Constructs with nullptr, creates a retain_ptr that refers to nothing
+    constexpr retain_ptr(std::nullptr_t) noexcept
+    : _ptr{}
+    { }
+
+    /// Takes a new reference on p
+    explicit retain_ptr(pointer p)
+    : retain_ptr{p, retain_object}
+    { }
+
+    /// Takes a new reference on p
+    retain_ptr(pointer p, retain_object_t)
+    : _ptr{p}
+    { if (_ptr) traits_type::increment(_ptr); }
+
+    /// Adopts the reference on p held by the caller
+    retain_ptr(pointer p, adopt_object_t) noexcept
+    : _ptr{p}
+    { }
+
+    /// Copy constructor: takes a new reference on the object of rp
+    retain_ptr(const retain_ptr& rp) noexcept
+    : _ptr{rp._ptr}
+    { if (_ptr) traits_type::increment(_ptr); }
+
+    /// Move constructor: takes over the reference held by rp
+    retain_ptr(retain_ptr&& rp) noexcept
+    : _ptr{rp._ptr}
+    { rp._ptr = nullptr; }
+
+    // destructor
+
+    /// Drops the reference if the stored pointer is not null
+    ~retain_ptr()
+    { if (_ptr) traits_type::decrement(_ptr); }
+
+    // assignment
+
+    /// Copy assignment
+    retain_ptr&
+    operator=(const retain_ptr& rp) noexcept
+    {
+        retain_ptr{rp}.swap(*this);
+        return *this;
+    }
+
+    /// Move assignment
+    retain_ptr&
+    operator=(retain_ptr&& rp) noexcept
+    {
+        retain_ptr{std::move(rp)}.swap(*this);
+        return *this;
+    }
+
+    /// Resets retain_ptr to empty if assigned to nullptr
+    retain_ptr&
+    operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    // observers
+
+    /// Dereferences pointer to the object
+    element_type&
+    operator*() const noexcept
+    {
+        assert(_ptr != nullptr);
+        return *_ptr;
+    }
+
+    /// Dereferences pointer to the object
+    pointer
+    operator->() const noexcept
+    {
+        assert(_ptr != nullptr);
+        return _ptr;
+    }
+
+    /// Gets the stored pointer
+    pointer
+    get() const noexcept
+    { return _ptr; }
+
+    /// Checks if there is an associated object
+    explicit operator bool() const noexcept
+    { return (_ptr) ? true : false; }
+
+    // modifiers
+
+    /// Releases the reference to the caller, without dropping it
+    pointer
+    release() noexcept
+    {
+        pointer cp = _ptr;
+        _ptr = nullptr;
+        return cp;
+    }
+
+    /// Drops the reference and resets retain_ptr to empty
+    void
+    reset() noexcept
+    { retain_ptr{}.swap(*this); }
+
+    /// Drops the reference and takes a new reference on p
+    void
+    reset(pointer p, retain_object_t = retain_object)
+    { retain_ptr{p, retain_object}.swap(*this); }
+
+    /// Drops the reference and adopts the reference on p held by the caller
+    void
+    reset(pointer p, adopt_object_t) noexcept
+    { retain_ptr{p, adopt_object}.swap(*this); }
+
+    /// Swaps with another retain_ptr
+    void
+    swap(retain_ptr& rp) noexcept
+    {
+        using std::swap;
+        swap(_ptr, rp._ptr);
+    }
+
+private:
+    pointer _ptr;
+};
+
+// retain_ptr comparisons
+
+/// Operator == overloading
+template<typename T, typename R, typename U, typename S>
+    inline bool
+    operator==(const retain_ptr<T, R>& rp1, const retain_ptr<U, S>& rp2) noexcept
+    { return rp1.get() == rp2.get(); }
+
+template<typename T, typename R>
+    inline bool
+    operator==(const retain_ptr<T, R>& rp, std::nullptr_t) noexcept
+    { return !rp; }
+
+template<typename T, typename R>
+    inline bool
+    operator==(std::nullptr_t, const retain_ptr<T, R>& rp) noexcept
+    { return !rp; }
+
+/// Operator != overloading
+template<typename T, typename R, typename U, typename S>
+    inline bool
+    operator!=(const retain_ptr<T, R>& rp1, const retain_ptr<U, S>& rp2) noexcept
+    { return rp1.get() != rp2.get(); }
+
+template<typename T, typename R>
+    inline bool
+    operator!=(const retain_ptr<T, R>& rp, std::nullptr_t) noexcept
+    { return bool{rp}; }
+
+template<typename T, typename R>
+    inline bool
+    operator!=(std::nullptr_t, const retain_ptr<T, R>& rp) noexcept
+    { return bool{rp}; }
+
+/// Operator < overloading
+template<typename T, typename R, typename U, typename S>
+    inline bool
+    operator<(const retain_ptr<T, R>& rp1, const retain_ptr<U, S>& rp2)
+    {
+        using _CT = typename std::common_type<T*, U*>::type;
+        return std::less<_CT>()(rp1.get(), rp2.get());
+    }
+
+/// Swaps with another retain_ptr
+template<typename T, typename R>
+    inline void
+    swap(retain_ptr<T, R>& rp1, retain_ptr<T, R>& rp2) noexcept
+    { rp1.swap(rp2); }
+
+} // namespace smart_ptr
+
+namespace std {
+
+// Template specialization of std::hash for smart_ptr::retain_ptr<T, R>
+
+template<typename T, typename R>
+struct hash<smart_ptr::retain_ptr<T, R>> {
+    using result_type = std::size_t;
+    using argument_type = smart_ptr::retain_ptr<T, R>;
+
+    std::size_t
+    operator()(const smart_ptr::retain_ptr<T, R>& rp) const {
+        return hash<T*>()(rp.get());
+    }
+};
+
+} // namespace std
+
+#endif
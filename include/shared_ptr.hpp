@@ -6,9 +6,10 @@
 #include <cstddef>      /// nullptr_t, size_t, ptrdiff_t
 #include <utility>      /// move, forward, swap
 #include <functional>   /// less, hash
+#include <vector>       /// vector
 #include <iostream>     /// basic_ostream
 #include <type_traits>  /// extent, remove_extent, is_array, is_void
-                            /// common_type
+                            /// common_type, integral_constant, conditional
 
 #include "control_block.hpp"
 #include "bad_weak_ptr.hpp"
@@ -23,6 +24,8 @@ template<typename T, typename D> class unique_ptr;
 template<typename T> class shared_ptr;
 template<typename T> class weak_ptr;
 
+namespace detail { struct sp_access; }
+
 // shared_ptr_access general template
 // Defines operator*, operator-> and operator[]
 // for T not array or cv void
@@ -65,11 +68,12 @@ public:
     using element_type = typename std::remove_extent<T>::type;
 
     /// Index operator, dereferencing operators are not provided
-    element_type* 
+    element_type&
     operator[](std::ptrdiff_t i) const noexcept
     {
         assert(_get() != nullptr);
-	    static_assert(!std::extent<T>::value || i < std::extent<T>::value);
+        assert(!std::extent<T>::value ||
+               static_cast<std::size_t>(i) < std::extent<T>::value);
         return _get()[i];
     }
 
@@ -107,10 +111,11 @@ private:
 /* supports shared_ptr<T[]> and shared_ptr<T[N]>: added in C++17 */
 
 /**
- * NOT implemented: custom allocator support.
+ * NOT implemented: custom allocator support in the constructors.
  * 
  * The allocator is intended to be used to allocate and deallocate
  *  internal shared_ptr details, not the object.
+ *  (allocate_shared is supported.)
  */
 
 template<typename T>
@@ -125,6 +130,8 @@ public:
     template<typename D, typename U>
     friend D* get_deleter(const shared_ptr<U>&) noexcept;
 
+    friend struct detail::sp_access;
+
     using element_type = typename shared_ptr_access<T>::element_type;
     using weak_type = weak_ptr<T>; /* added in C++17 */
 
@@ -236,11 +243,8 @@ public:
     : _ptr{wp._ptr},
       _control_block{wp._control_block}
     {
-        if (wp.expired()) {
+        if (!_control_block || !_control_block->try_inc_ref())
             throw bad_weak_ptr{};
-        } else {
-            _control_block->inc_ref();
-        }
     }
 
     /// Constructs a shared_ptr object that obtains ownership from up
@@ -392,17 +396,236 @@ private:
     detail::control_block_base* _control_block;
 };
 
+namespace detail {
+
+// Back door to the internals of shared_ptr for the factories and
+//  helpers below that manage references on the control block themselves
+
+struct sp_access {
+    /// Gets the control block of sp
+    template<typename T>
+    static control_block_base*
+    get_control_block(const shared_ptr<T>& sp) noexcept
+    { return sp._control_block; }
+
+    /// Creates a shared_ptr that adopts one reference already taken on cb
+    template<typename T>
+    static shared_ptr<T>
+    adopt(typename shared_ptr<T>::element_type* p,
+          control_block_base* cb) noexcept
+    {
+        shared_ptr<T> sp;
+        sp._ptr = p;
+        sp._control_block = cb;
+        return sp;
+    }
+
+    /// Empties sp without dropping its reference, which is handed to the caller
+    template<typename T>
+    static control_block_base*
+    release(shared_ptr<T>& sp) noexcept
+    {
+        auto cb = sp._control_block;
+        sp._ptr = nullptr;
+        sp._control_block = nullptr;
+        return cb;
+    }
+};
+
+} // namespace detail
+
 // 20.7.2.2.6, shared_ptr creation
 
+/**
+ * make_shared places objects of at most make_shared_inplace_threshold bytes
+ *  inside their control block, which saves an allocation. Larger objects
+ *  get a separate allocation, so that their memory is returned as soon as
+ *  the last shared_ptr goes, rather than pinned by lingering weak_ptrs.
+ *  An object in its control block has no deleter: get_deleter returns a
+ *  null pointer for it.
+ *
+ * Specialize make_shared_inplace to choose the layout for a given type.
+ */
+
+constexpr std::size_t make_shared_inplace_threshold = 1024;
+
+template<typename T>
+struct make_shared_inplace
+    : std::integral_constant<bool,
+        sizeof(T) <= make_shared_inplace_threshold> { };
+
+namespace detail {
+
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared(std::true_type, Args&&... args)
+    {
+        auto _cb = new inplace_control_block<T>{std::forward<Args>(args)...};
+        return sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared(std::false_type, Args&&... args)
+    {
+        // An over-aligned T that new T would misalign needs its own deleter
+        using _Delete = typename std::conditional<overaligned_new<T>::value,
+            object_delete<T>, default_delete<T>>::type;
+        return shared_ptr<T>{new_object<T>(std::forward<Args>(args)...), _Delete{}};
+    }
+
+} // namespace detail
+
 /// Creates a shared_ptr that manages a new object
 template<typename T, typename... Args>
     inline shared_ptr<T>
     make_shared(Args&&... args)
-    { return shared_ptr<T>{new T{std::forward<Args>(args)...}}; }
+    {
+        return detail::make_shared<T>(
+            std::integral_constant<bool, make_shared_inplace<T>::value>{},
+            std::forward<Args>(args)...);
+    }
 
+/// Creates a shared_ptr that manages a new object allocated apart from the
+///     control block, whatever its size: the object's memory is returned
+///     once the last shared_ptr goes, even if weak_ptrs outlive it
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_weak_friendly(Args&&... args)
+    { return detail::make_shared<T>(std::false_type{}, std::forward<Args>(args)...); }
+
+/**
+ * A reader copying a shared_ptr writes the reference counts, and a writer
+ *  mutating a small object writes the object. make_shared packs both into
+ *  one block, often into one cache line, so that each write invalidates
+ *  the line in every other core's cache (false sharing). For objects that
+ *  are written while their shared_ptrs are copied concurrently,
+ *  make_shared_isolated gives the counts and the object cache lines of
+ *  their own, at the cost of padding the block to whole lines.
+ */
+
+/// Assumed size of a cache line, 64 bytes on x86-64 and most arm64 cores
+constexpr std::size_t cache_line_size = 64;
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block, with the reference counts on a cache line of
+///     their own
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_isolated(Args&&... args)
+    {
+        auto _cb = new detail::inplace_control_block<T, cache_line_size>{
+            std::forward<Args>(args)...};
+        return detail::sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+/// Creates a shared_ptr that manages a new object, allocated together with
+///     its control block by a copy of the allocator a
 template<typename T, typename A, typename... Args>
     inline shared_ptr<T>
-    allocate_shared(const A& a, Args&&... args) = delete;
+    allocate_shared(const A& a, Args&&... args)
+    {
+        auto _cb = detail::inplace_alloc_control_block<T, A>::create(
+            a, std::forward<Args>(args)...);
+        return detail::sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+/// Creates a shared_ptr that manages a new immortal object, which is never
+///     destroyed. Copies skip reference counting and use_count() reports
+///     immortal_use_count. Meant for interned constants and sentinels that
+///     live until the program exits.
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_immortal_shared(Args&&... args)
+    {
+        auto _cb = new detail::immortal_control_block<T>{std::forward<Args>(args)...};
+        return detail::sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+/// Creates a shared_ptr that manages a new object allocated together with
+///     a control block that keeps no weak count. weak_ptrs formed from it
+///     are empty.
+template<typename T, typename... Args>
+    inline shared_ptr<T>
+    make_shared_noweak(Args&&... args)
+    {
+        auto _cb = new detail::noweak_control_block<T>{std::forward<Args>(args)...};
+        return detail::sp_access::adopt<T>(_cb->get(), _cb);
+    }
+
+/// Creates n objects, each constructed from args, in one contiguous
+///     allocation with a single control block, and returns a shared_ptr to
+///     each of them. The objects are destroyed together when the last
+///     shared_ptr to any of them goes; their storage is freed once no
+///     weak_ptr to any of them is left either. Throws bad_array_new_length
+///     if the size of n objects overflows.
+template<typename T, typename... Args>
+    inline std::vector<shared_ptr<T>>
+    make_shared_batch(std::size_t n, const Args&... args)
+    {
+        std::vector<shared_ptr<T>> _sps;
+        if (n == 0) return _sps;
+        auto _cb = detail::batch_control_block<T>::create(n, args...);
+        auto _objs = _cb->get();
+        auto _first = detail::sp_access::adopt<T>(_objs, _cb); // frees the batch if reserve throws
+        _sps.reserve(n);
+        _cb->inc_ref(static_cast<long>(n - 1));
+        _sps.push_back(std::move(_first));
+        for (std::size_t _i = 1; _i < n; ++_i)
+            _sps.push_back(detail::sp_access::adopt<T>(_objs + _i, _cb));
+        return _sps;
+    }
+
+// Bulk sharing: n owning copies for the price of one reference count update
+
+/// Writes n copies of sp to out, taking all n references with a single
+///     atomic increment. Returns the iterator past the last copy written.
+template<typename T, typename OutputIt>
+    OutputIt
+    share_n(const shared_ptr<T>& sp, std::size_t n, OutputIt out)
+    {
+        auto _cb = detail::sp_access::get_control_block(sp);
+        if (!_cb || n == 0) {
+            for (; n > 0; --n, ++out) *out = sp;
+            return out;
+        }
+        _cb->inc_ref(static_cast<long>(n));
+        std::size_t _built = 0;
+        try {
+            for (; _built < n; ++out) {
+                auto _copy = detail::sp_access::adopt<T>(sp.get(), _cb);
+                ++_built; // its reference is now owned by _copy
+                *out = std::move(_copy);
+            }
+        } catch (...) {
+            if (n > _built)
+                _cb->dec_ref(static_cast<long>(n - _built)); // copies never built
+            throw;
+        }
+        return out;
+    }
+
+/// Resets the n shared_ptrs starting at first, dropping the references of
+///     each run of copies that share a control block with a single
+///     atomic decrement. Returns the iterator past the last one released.
+template<typename ForwardIt>
+    ForwardIt
+    release_n(ForwardIt first, std::size_t n)
+    {
+        detail::control_block_base* _run = nullptr;
+        long _count = 0;
+        for (; n > 0; --n, ++first) {
+            auto _cb = detail::sp_access::release(*first);
+            if (_cb != _run) {
+                if (_run) _run->dec_ref(_count);
+                _run = _cb;
+                _count = 0;
+            }
+            ++_count;
+        }
+        if (_run) _run->dec_ref(_count);
+        return first;
+    }
 
 // 20.7.2.2.7, shared_ptr comparisons
 
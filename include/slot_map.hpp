@@ -0,0 +1,232 @@
+// generational slot map
+
+/**
+ * A slot_map<T> owns its objects and hands out handle<T>s to them, an
+ *  index into a table of slots and the generation of the slot. Erasing an
+ *  object bumps its slot's generation, so that the handles to it no longer
+ *  match: like a weak_ptr, a handle can tell whether its object is gone,
+ *  but without a control block per object, and checking it is a plain load
+ *  and compare instead of an atomic operation:
+ *
+ *      slot_map<Entity> entities;
+ *      handle<Entity> h = entities.insert(args...);
+ *      if (Entity* e = entities.get(h)) ...
+ *      entities.erase(h);              // entities.get(h) == nullptr now
+ *      for (Entity& e : entities) ...
+ *
+ * Objects are kept contiguous, in no particular order: erasing one moves
+ *  the last object into its place. This invalidates pointers and iterators,
+ *  but not handles. Handles stay valid when the slot map is moved, e.g. into
+ *  a unique_ptr<slot_map<T>>. A slot map is not synchronized.
+ *
+ * See slot_map_bench.cpp for iteration and lookup against shared_ptr and
+ *  weak_ptr.
+ */
+
+#ifndef SLOT_MAP_HPP
+#define SLOT_MAP_HPP 1
+
+#include <cstddef>      // size_t
+#include <cstdint>      // uint32_t
+#include <vector>       // vector
+#include <utility>      // forward, move
+
+namespace smart_ptr {
+
+// Class template handle, refers to an object in a slot_map
+
+template<typename T>
+struct handle {
+    /// Default constructor, creates a handle that refers to nothing
+    constexpr handle() noexcept = default;
+
+    constexpr handle(std::uint32_t i, std::uint32_t g) noexcept
+    : index{i},
+      generation{g}
+    { }
+
+    /// Slot of the object
+    std::uint32_t index = 0;
+    /// Generation of the slot when the object was inserted, never 0
+    std::uint32_t generation = 0;
+
+    /// Whether the handle was obtained from a slot map, it may be stale
+    explicit operator bool() const noexcept
+    { return generation != 0; }
+};
+
+template<typename T>
+    inline bool
+    operator==(const handle<T>& h1, const handle<T>& h2) noexcept
+    { return h1.index == h2.index && h1.generation == h2.generation; }
+
+template<typename T>
+    inline bool
+    operator!=(const handle<T>& h1, const handle<T>& h2) noexcept
+    { return !(h1 == h2); }
+
+// Class template slot_map
+
+template<typename T>
+class slot_map {
+public:
+    using value_type = T;
+    using iterator = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    slot_map() = default;
+
+    // Modifiers
+
+    /// Constructs an object in place, returns a handle to it
+    template<typename... Args>
+    handle<T>
+    insert(Args&&... args)
+    {
+        std::uint32_t _i;
+        if (_free_head != _none) {
+            _i = _free_head;
+            _free_head = _slots[_i].index;
+        } else {
+            _i = static_cast<std::uint32_t>(_slots.size());
+            _slots.push_back(_Slot{0, 1});
+        }
+        try {
+            _values.emplace_back(std::forward<Args>(args)...);
+            _slot_of.push_back(_i);
+        } catch (...) {
+            if (_values.size() > _slot_of.size()) _values.pop_back();
+            _slots[_i].index = _free_head;
+            _free_head = _i;
+            throw;
+        }
+        _slots[_i].index = static_cast<std::uint32_t>(_values.size() - 1);
+        return handle<T>{_i, _slots[_i].generation};
+    }
+
+    /// Destroys the object h refers to, false if h is stale
+    bool
+    erase(handle<T> h)
+    {
+        if (!contains(h)) return false;
+        const std::uint32_t _pos = _slots[h.index].index;
+        const std::uint32_t _last = static_cast<std::uint32_t>(_values.size() - 1);
+        if (_pos != _last) {
+            _values[_pos] = std::move(_values[_last]);
+            _slot_of[_pos] = _slot_of[_last];
+            _slots[_slot_of[_pos]].index = _pos;
+        }
+        _values.pop_back();
+        _slot_of.pop_back();
+
+        auto& _s = _slots[h.index];
+        if (++_s.generation == 0) _s.generation = 1;
+        _s.index = _free_head;
+        _free_head = h.index;
+        return true;
+    }
+
+    /// Destroys all objects, all handles become stale
+    void
+    clear()
+    {
+        while (!_values.empty()) {
+            const std::uint32_t _i = _slot_of.back();
+            erase(handle<T>{_i, _slots[_i].generation});
+        }
+    }
+
+    // Observers
+
+    /// Whether h refers to an object of the slot map
+    bool
+    contains(handle<T> h) const noexcept
+    { return h.index < _slots.size() && _slots[h.index].generation == h.generation; }
+
+    /// Gets the object h refers to, nullptr if h is stale
+    T*
+    get(handle<T> h) noexcept
+    { return contains(h) ? &_values[_slots[h.index].index] : nullptr; }
+
+    const T*
+    get(handle<T> h) const noexcept
+    { return contains(h) ? &_values[_slots[h.index].index] : nullptr; }
+
+    /// Gets the object h refers to, h shall not be stale
+    T&
+    operator[](handle<T> h) noexcept
+    { return _values[_slots[h.index].index]; }
+
+    const T&
+    operator[](handle<T> h) const noexcept
+    { return _values[_slots[h.index].index]; }
+
+    /// Gets a handle to value, an object of the slot map
+    handle<T>
+    handle_of(const T& value) const noexcept
+    {
+        const std::uint32_t _i = _slot_of[static_cast<std::size_t>(&value - _values.data())];
+        return handle<T>{_i, _slots[_i].generation};
+    }
+
+    std::size_t
+    size() const noexcept
+    { return _values.size(); }
+
+    bool
+    empty() const noexcept
+    { return _values.empty(); }
+
+    /// Reserves room for n objects
+    void
+    reserve(std::size_t n)
+    {
+        _values.reserve(n);
+        _slot_of.reserve(n);
+        _slots.reserve(n);
+    }
+
+    // Iteration over the objects, stored contiguously
+
+    T*
+    data() noexcept
+    { return _values.data(); }
+
+    iterator
+    begin() noexcept
+    { return _values.begin(); }
+
+    iterator
+    end() noexcept
+    { return _values.end(); }
+
+    const_iterator
+    begin() const noexcept
+    { return _values.begin(); }
+
+    const_iterator
+    end() const noexcept
+    { return _values.end(); }
+
+private:
+    /// index is the object's position while the slot is in use, and the
+    ///     next free slot while it is not
+    struct _Slot {
+        std::uint32_t index;
+        std::uint32_t generation;
+    };
+
+    static constexpr std::uint32_t _none = ~std::uint32_t{0};
+
+    std::vector<T> _values;
+    std::vector<std::uint32_t> _slot_of;
+    std::vector<_Slot> _slots;
+    std::uint32_t _free_head = _none;
+};
+
+template<typename T>
+constexpr std::uint32_t slot_map<T>::_none;
+
+} // namespace smart_ptr
+
+#endif
@@ -8,6 +8,8 @@
 #include <utility>      /// move, forward, swap
 #include <functional>   /// less, hash
 #include <type_traits>  /// remove_extent, conditional, is_reference, common_type
+#include <memory>       /// allocator_traits
+#include <tuple>        /// tuple, get
 
 #include "ptr.hpp"
 #include "default_delete.hpp"
@@ -377,6 +379,9 @@ template<typename T, std::size_t N>
     };
 
 /// Only for non-array types
+/// The object is created with new T, to match the delete of default_delete,
+///     so before C++17 an over-aligned T is misaligned, as with
+///     std::make_unique; make_shared aligns it.
 template<typename T, typename... Args>
     typename _Unique_if<T>::_Single_object
     make_unique(Args&&... args) {
@@ -396,6 +401,156 @@ template<typename T, typename... Args>
     typename _Unique_if<T>::_Known_bound
     make_unique(Args&&...) = delete;
 
+// allocator_delete, deleter for objects created by allocate_unique
+
+/**
+ * The deleter destroys and frees objects with the allocator they were
+ *  allocated with. It keeps the allocator in a tuple it derives from, so
+ *  that for a stateless allocator the deleter is an empty class too, and
+ *  unique_ptr's own tuple leaves it no space: allocate_unique with
+ *  std::allocator gives a unique_ptr the size of a pointer.
+ *
+ * allocator_delete<A[]> frees arrays, and remembers their length.
+ */
+
+template<typename A>
+class allocator_delete : private std::tuple<A>
+{
+    using _Traits = std::allocator_traits<A>;
+
+public:
+    using allocator_type = A;
+    using pointer = typename _Traits::value_type*;
+
+    /// Default constructor, for a unique_ptr that owns nothing
+    allocator_delete() = default;
+
+    /// Constructs the deleter of objects allocated with a
+    explicit allocator_delete(const A& a)
+    : std::tuple<A>{a}
+    { }
+
+    /// Call operator, destroys the object and frees it
+    void operator()(pointer p) const
+    {
+        A _a{get_allocator()};
+        _Traits::destroy(_a, p);
+        _Traits::deallocate(_a, p, 1);
+    }
+
+    /// Gets the allocator
+    const A&
+    get_allocator() const noexcept
+    { return std::get<0>(static_cast<const std::tuple<A>&>(*this)); }
+};
+
+template<typename A>
+class allocator_delete<A[]> : private std::tuple<A>
+{
+    using _Traits = std::allocator_traits<A>;
+
+public:
+    using allocator_type = A;
+    using pointer = typename _Traits::value_type*;
+
+    /// Default constructor, for a unique_ptr that owns nothing
+    allocator_delete()
+    : _n{0}
+    { }
+
+    /// Constructs the deleter of n elements allocated with a
+    allocator_delete(const A& a, std::size_t n)
+    : std::tuple<A>{a},
+      _n{n}
+    { }
+
+    /// Call operator, destroys the elements and frees the array
+    void operator()(pointer p) const
+    {
+        A _a{get_allocator()};
+        for (std::size_t _i = _n; _i > 0; --_i)
+            _Traits::destroy(_a, p + (_i - 1));
+        _Traits::deallocate(_a, p, _n);
+    }
+
+    /// Gets the allocator
+    const A&
+    get_allocator() const noexcept
+    { return std::get<0>(static_cast<const std::tuple<A>&>(*this)); }
+
+    /// Number of elements of the array
+    std::size_t
+    size() const noexcept
+    { return _n; }
+
+private:
+    std::size_t _n;
+};
+
+// allocate_unique: creates a unique pointer that manages a new object
+//  allocated by an allocator
+
+template<typename T, typename A>
+    struct _Allocate_unique_if {
+        using _Alloc = typename std::allocator_traits<A>::template rebind_alloc<T>;
+        using _Single_object = unique_ptr<T, allocator_delete<_Alloc>>;
+    };
+
+template<typename T, typename A>
+    struct _Allocate_unique_if<T[], A> {
+        using _Alloc = typename std::allocator_traits<A>::template rebind_alloc<T>;
+        using _Unknown_bound = unique_ptr<T[], allocator_delete<_Alloc[]>>;
+    };
+
+template<typename T, std::size_t N, typename A>
+    struct _Allocate_unique_if<T[N], A> {
+        using _Known_bound = void;
+    };
+
+/// Only for non-array types
+template<typename T, typename A, typename... Args>
+    typename _Allocate_unique_if<T, A>::_Single_object
+    allocate_unique(const A& a, Args&&... args) {
+        using _Alloc = typename _Allocate_unique_if<T, A>::_Alloc;
+        using _Traits = std::allocator_traits<_Alloc>;
+        _Alloc _a{a};
+        T* _p = _Traits::allocate(_a, 1);
+        try {
+            _Traits::construct(_a, _p, std::forward<Args>(args)...);
+        } catch (...) {
+            _Traits::deallocate(_a, _p, 1);
+            throw;
+        }
+        return unique_ptr<T, allocator_delete<_Alloc>>{_p, allocator_delete<_Alloc>{_a}};
+    }
+
+/// Only for array types with unknown bound, value-initializes n elements
+template<typename T, typename A>
+    typename _Allocate_unique_if<T, A>::_Unknown_bound
+    allocate_unique(const A& a, std::size_t n) {
+        using U = typename std::remove_extent<T>::type;
+        using _Alloc = typename _Allocate_unique_if<T, A>::_Alloc;
+        using _Traits = std::allocator_traits<_Alloc>;
+        _Alloc _a{a};
+        U* _p = _Traits::allocate(_a, n);
+        std::size_t _i = 0;
+        try {
+            for (; _i < n; ++_i)
+                _Traits::construct(_a, _p + _i);
+        } catch (...) {
+            for (; _i > 0; --_i)
+                _Traits::destroy(_a, _p + (_i - 1));
+            _Traits::deallocate(_a, _p, n);
+            throw;
+        }
+        return unique_ptr<T, allocator_delete<_Alloc[]>>{_p, allocator_delete<_Alloc[]>{_a, n}};
+    }
+
+/// Only for array types with known bound: unspecified
+template<typename T, typename A, typename... Args>
+    typename _Allocate_unique_if<T, A>::_Known_bound
+    allocate_unique(const A&, Args&&...) = delete;
+
 // 20.7.1.4 unique_ptr specialized algorithms
 
 /// Operator == overloading
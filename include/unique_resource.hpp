@@ -0,0 +1,142 @@
+// unique_resource implementation
+
+/**
+ * unique_resource manages a resource handle that is not a pointer, like a
+ *  file descriptor, with exclusive ownership semantics: the deleter is
+ *  called on the handle when the unique_resource is destroyed or reset.
+ *
+ * As in unique_ptr, the handle and the deleter are stored in a tuple, so a
+ *  stateless deleter such as deleter_fn takes no space.
+ *
+ *      auto fd = make_unique_resource_checked(::open(path, O_RDONLY), -1,
+ *                                             deleter_fn<decltype(&::close), &::close>{});
+ */
+
+#ifndef UNIQUE_RESOURCE_HPP
+#define UNIQUE_RESOURCE_HPP 1
+
+#include <tuple>        // tuple, get(tuple)
+#include <utility>      // move, forward
+#include <type_traits>  // decay
+
+#include "default_delete.hpp"
+
+namespace smart_ptr {
+
+// Class template unique_resource
+
+template<typename R, typename D>
+class unique_resource {
+public:
+    using resource_type = R;
+    using deleter_type = D;
+
+    // constructors
+
+    /// Default constructor, creates a unique_resource that owns nothing
+    unique_resource()
+    : _impl{},
+      _execute_on_reset{false}
+    { }
+
+    /// Takes ownership of the resource r, released by calling d
+    template<typename RR, typename DD>
+    unique_resource(RR&& r, DD&& d)
+    : _impl{std::forward<RR>(r), std::forward<DD>(d)},
+      _execute_on_reset{true}
+    { }
+
+    /// Move constructor: takes ownership from ur
+    unique_resource(unique_resource&& ur)
+    : _impl{std::move(ur._impl)},
+      _execute_on_reset{ur._execute_on_reset}
+    { ur.release(); }
+
+    // destructor
+
+    /// Releases the resource if still owned
+    ~unique_resource()
+    { reset(); }
+
+    // assignment
+
+    /// Move assignment: releases the owned resource, takes ownership from ur
+    unique_resource&
+    operator=(unique_resource&& ur)
+    {
+        reset();
+        _impl = std::move(ur._impl);
+        _execute_on_reset = ur._execute_on_reset;
+        ur.release();
+        return *this;
+    }
+
+    // modifiers
+
+    /// Releases the resource if still owned
+    void
+    reset() noexcept
+    {
+        if (_execute_on_reset) {
+            _execute_on_reset = false;
+            get_deleter()(get());
+        }
+    }
+
+    /// Releases the resource if still owned, then takes ownership of r
+    template<typename RR>
+    void
+    reset(RR&& r)
+    {
+        reset();
+        std::get<0>(_impl) = std::forward<RR>(r);
+        _execute_on_reset = true;
+    }
+
+    /// Gives up ownership: the deleter will not be called
+    void
+    release() noexcept
+    { _execute_on_reset = false; }
+
+    // observers
+
+    /// Gets the resource handle
+    const resource_type&
+    get() const noexcept
+    { return std::get<0>(_impl); }
+
+    /// Gets a const reference to the stored deleter
+    const deleter_type&
+    get_deleter() const noexcept
+    { return std::get<1>(_impl); }
+
+    // Disable copy
+
+    /// Disables copy constructor
+    unique_resource(const unique_resource&) = delete;
+
+    /// Disables copy assignment
+    unique_resource& operator=(const unique_resource&) = delete;
+
+private:
+    std::tuple<R, D> _impl;
+    bool _execute_on_reset;
+};
+
+/// Creates a unique_resource that owns r only if r is not the invalid
+///     value, e.g. the -1 returned by open on failure
+template<typename R, typename D, typename S>
+    inline unique_resource<typename std::decay<R>::type, typename std::decay<D>::type>
+    make_unique_resource_checked(R&& r, const S& invalid, D&& d)
+    {
+        const bool _valid = !(r == invalid);
+        unique_resource<typename std::decay<R>::type,
+                        typename std::decay<D>::type> _ur{std::forward<R>(r),
+                                                          std::forward<D>(d)};
+        if (!_valid) _ur.release();
+        return _ur;
+    }
+
+} // namespace smart_ptr
+
+#endif
@@ -4,9 +4,12 @@
 #define WEAK_PTR_HPP 1
 
 #include <type_traits>      // remove_extent
+#include <utility>          // move
+#include <functional>       // less
 
 #include "control_block.hpp"
 #include "shared_ptr.hpp"
+#include "expiry.hpp"
 
 namespace smart_ptr {
 
@@ -14,6 +17,28 @@ namespace smart_ptr {
 
 template<typename T> class shared_ptr;
 
+namespace detail {
+
+struct wp_access;
+
+/// Expiry callback holding a function object f
+template<typename F>
+class expiry_callback_impl : public expiry_callback {
+public:
+    explicit expiry_callback_impl(F f)
+    : _f(std::move(f))
+    { }
+
+    void
+    run() noexcept override
+    { _f(); }
+
+private:
+    F _f;
+};
+
+} // namespace detail
+
 // 20.7.2.3 Class template weak_ptr
 
 template <typename T>
@@ -25,6 +50,8 @@ public:
     template<typename U>
     friend class weak_ptr;
 
+    friend struct detail::wp_access;
+
     using element_type = typename std::remove_extent<T>::type;
 
     // 20.7.2.3.1, constructors:
@@ -37,12 +64,22 @@ public:
     { }
 
     /// Conversion constructor: shares ownership with sp
-    /// Postconditions: use_count() == sp.use_count().
+    /// Postconditions: use_count() == sp.use_count(), or use_count() == 0
+    ///     if sp was created by make_shared_noweak.
     template<class U>
     weak_ptr(shared_ptr<U> const& sp) noexcept
     : _ptr{sp._ptr},
       _control_block{sp._control_block}
-    { if (_control_block) _control_block->inc_wref(); } 
+    {
+        if (_control_block) {
+            if (_control_block->weak_enabled()) {
+                _control_block->inc_wref();
+            } else {
+                _ptr = nullptr;
+                _control_block = nullptr;
+            }
+        }
+    }
 
     /// Copy constructor: shares ownership with wp
     /// Postconditions: use_count() == wp.use_count().
@@ -115,12 +152,47 @@ public:
     /// Checks if use_count == 0
     bool
     expired() const noexcept
-    { return (_control_block) ? _control_block->expired() : false; }
+    { return (_control_block) ? _control_block->expired() : true; }
 
     /// Checks if there is a managed object
     shared_ptr<T>
     lock() const noexcept
-    { return (expired()) ? shared_ptr<T>{} : shared_ptr<T>{*this}; }
+    {
+        // One step, as the object may expire right after a separate test
+        shared_ptr<T> _sp;
+        if (_control_block && _control_block->try_inc_ref()) {
+            _sp._ptr = _ptr;
+            _sp._control_block = _control_block;
+        }
+        return _sp;
+    }
+
+    /// Registers f to be called once the managed object expires, or calls
+    ///     it at once if it has, see expiry.hpp
+    template<typename F>
+    expiry_token
+    on_expire(F f) const
+    {
+        if (expired()) {
+            f();
+            return expiry_token{};
+        }
+        auto _list = _control_block->expiry_callbacks();
+        if (!_list) {
+            // Expired meanwhile, or immortal
+            if (_control_block->expired()) f();
+            return expiry_token{};
+        }
+        auto _cb = new detail::expiry_callback_impl<F>{std::move(f)};
+        const std::size_t _id = _list->add(_cb);
+        if (!_id) {
+            // Closed by the last shared_ptr, which has destroyed the object
+            _cb->run();
+            delete _cb;
+            return expiry_token{};
+        }
+        return expiry_token{_list, _id};
+    }
 
     /// Checks whether this shared_ptr precedes other in owner-based order
     /// Implemented by comparing the address of control_block
@@ -145,6 +217,38 @@ private:
     detail::control_block_base* _control_block;
 };
 
+namespace detail {
+
+// Back door to the internals of weak_ptr, see sp_access
+
+struct wp_access {
+    /// Gets the control block of wp
+    template<typename T>
+    static control_block_base*
+    get_control_block(const weak_ptr<T>& wp) noexcept
+    { return wp._control_block; }
+
+    /// Gets the stored pointer of wp
+    template<typename T>
+    static typename weak_ptr<T>::element_type*
+    get(const weak_ptr<T>& wp) noexcept
+    { return wp._ptr; }
+
+    /// Creates a weak_ptr that adopts one weak reference already taken on cb
+    template<typename T>
+    static weak_ptr<T>
+    adopt(typename weak_ptr<T>::element_type* p,
+          control_block_base* cb) noexcept
+    {
+        weak_ptr<T> wp;
+        wp._ptr = p;
+        wp._control_block = cb;
+        return wp;
+    }
+};
+
+} // namespace detail
+
 // 20.7.2.3.6, specialized algorithm
 
 /// Swaps with another weak_ptr
@@ -0,0 +1,309 @@
+// containers of weak_ptrs that drop expired entries
+
+/**
+ * A set or map of weak_ptrs, e.g. a list of observers, keeps growing when
+ *  nobody removes the entries whose object is gone. weak_set<T>, keyed by
+ *  owner with owner_less, and weak_value_map<K, T> remove them as they go:
+ *  every insertion, lookup and erasure also checks the next sweep_step
+ *  entries after a cursor that wraps around the container, and erases the
+ *  expired ones. The cost of removal is thus spread over the operations,
+ *  and the number of expired entries stays bounded by that of live ones.
+ *
+ *      weak_set<Observer> observers;
+ *      observers.insert(sp);
+ *      observers.for_each([](const shared_ptr<Observer>& o) { o->notify(); });
+ *      observers.compact();            // drop all expired entries now
+ *
+ * compact() scans all entries at once, prefetching the control blocks of
+ *  the entries a few positions ahead, so that the cache misses on them
+ *  overlap. for_each also erases the expired entries it comes across; its
+ *  function must not modify the container.
+ *
+ * size() counts the entries not erased yet, live or not. The containers
+ *  are not synchronized.
+ */
+
+#ifndef WEAK_SET_HPP
+#define WEAK_SET_HPP 1
+
+#include <cstddef>      // size_t
+#include <set>          // set
+#include <map>          // map
+#include <functional>   // less
+#include <utility>      // pair, make_pair
+
+#include "shared_ptr.hpp"
+#include "weak_ptr.hpp"
+#include "owner_less.hpp"
+
+namespace smart_ptr {
+
+namespace detail {
+
+inline void
+prefetch(const void* p) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+// Common part of weak_set and weak_value_map
+
+/**
+ * C is the underlying set or map, W a function object that gets the
+ *  weak_ptr of one of its entries.
+ */
+
+template<typename C, typename W>
+class weak_container {
+public:
+    /// Number of entries checked by each operation
+    static constexpr std::size_t sweep_step = 2;
+
+    /// Distance in entries at which compact prefetches control blocks
+    static constexpr std::size_t prefetch_distance = 8;
+
+    weak_container(const weak_container&) = delete;
+    weak_container& operator=(const weak_container&) = delete;
+
+    /// Removes all expired entries, returns their number
+    std::size_t
+    compact()
+    {
+        const W _weak{};
+        auto _ahead = _entries.begin();
+        for (std::size_t _i = 0; _i < prefetch_distance && _ahead != _entries.end(); ++_i, ++_ahead)
+            prefetch(wp_access::get_control_block(_weak(*_ahead)));
+
+        std::size_t _removed = 0;
+        for (auto _it = _entries.begin(); _it != _entries.end(); ) {
+            if (_ahead != _entries.end()) {
+                prefetch(wp_access::get_control_block(_weak(*_ahead)));
+                ++_ahead;
+            }
+            if (_weak(*_it).expired()) {
+                _it = _erase(_it);
+                ++_removed;
+            } else {
+                ++_it;
+            }
+        }
+        return _removed;
+    }
+
+    void
+    clear() noexcept
+    {
+        _entries.clear();
+        _cursor = _entries.end();
+    }
+
+    /// Number of entries, including the expired ones not erased yet
+    std::size_t
+    size() const noexcept
+    { return _entries.size(); }
+
+    bool
+    empty() const noexcept
+    { return _entries.empty(); }
+
+protected:
+    using _Iter = typename C::iterator;
+
+    weak_container() = default;
+
+    /// Erases the expired entries among the sweep_step after the cursor
+    void
+    _sweep()
+    {
+        const W _weak{};
+        for (std::size_t _n = sweep_step; _n > 0 && !_entries.empty(); --_n) {
+            if (_cursor == _entries.end()) _cursor = _entries.begin();
+            if (_weak(*_cursor).expired()) _cursor = _entries.erase(_cursor);
+            else ++_cursor;
+        }
+    }
+
+    /// Erases the entry at it, keeping the cursor valid
+    _Iter
+    _erase(_Iter it)
+    {
+        if (it == _cursor) return _cursor = _entries.erase(it);
+        return _entries.erase(it);
+    }
+
+    C _entries;
+    _Iter _cursor = _entries.end();
+};
+
+template<typename C, typename W>
+constexpr std::size_t weak_container<C, W>::sweep_step;
+
+template<typename C, typename W>
+constexpr std::size_t weak_container<C, W>::prefetch_distance;
+
+template<typename T>
+struct weak_of_entry {
+    const weak_ptr<T>&
+    operator()(const weak_ptr<T>& wp) const noexcept
+    { return wp; }
+
+    template<typename K>
+    const weak_ptr<T>&
+    operator()(const std::pair<const K, weak_ptr<T>>& e) const noexcept
+    { return e.second; }
+};
+
+} // namespace detail
+
+// Class template weak_set, set of weak_ptrs ordered by owner
+
+template<typename T>
+class weak_set
+    : public detail::weak_container<std::set<weak_ptr<T>, owner_less<weak_ptr<T>>>,
+                                    detail::weak_of_entry<T>> {
+public:
+    using value_type = weak_ptr<T>;
+
+    weak_set() = default;
+
+    // Modifiers
+
+    /// Adds wp unless an entry shares its owner, true if added
+    bool
+    insert(const weak_ptr<T>& wp)
+    {
+        this->_sweep();
+        return this->_entries.insert(wp).second;
+    }
+
+    bool
+    insert(const shared_ptr<T>& sp)
+    { return insert(weak_ptr<T>{sp}); }
+
+    /// Removes the entry sharing wp's owner, true if there was one
+    bool
+    erase(const weak_ptr<T>& wp)
+    {
+        this->_sweep();
+        auto _it = this->_entries.find(wp);
+        if (_it == this->_entries.end()) return false;
+        this->_erase(_it);
+        return true;
+    }
+
+    bool
+    erase(const shared_ptr<T>& sp)
+    { return erase(weak_ptr<T>{sp}); }
+
+    // Observers
+
+    /// Whether an entry shares sp's owner
+    bool
+    contains(const shared_ptr<T>& sp)
+    {
+        this->_sweep();
+        return this->_entries.find(weak_ptr<T>{sp}) != this->_entries.end();
+    }
+
+    /// Calls f with a shared_ptr to each live object, erasing the entries
+    ///     of the expired ones
+    template<typename F>
+    void
+    for_each(F f)
+    {
+        for (auto _it = this->_entries.begin(); _it != this->_entries.end(); ) {
+            if (auto _sp = _it->lock()) {
+                ++_it;
+                f(_sp);
+            } else {
+                _it = this->_erase(_it);
+            }
+        }
+    }
+};
+
+// Class template weak_value_map, map of keys to weak_ptrs
+
+template<typename K, typename T, typename Compare = std::less<K>>
+class weak_value_map
+    : public detail::weak_container<std::map<K, weak_ptr<T>, Compare>,
+                                    detail::weak_of_entry<T>> {
+public:
+    using key_type = K;
+    using mapped_type = weak_ptr<T>;
+
+    weak_value_map() = default;
+
+    // Modifiers
+
+    /// Maps key to sp, unless key maps to a live object; true if mapped
+    bool
+    insert(const K& key, const shared_ptr<T>& sp)
+    {
+        this->_sweep();
+        auto _r = this->_entries.insert(std::make_pair(key, weak_ptr<T>{sp}));
+        if (_r.second) return true;
+        if (!_r.first->second.expired()) return false;
+        _r.first->second = sp;
+        return true;
+    }
+
+    /// Maps key to sp, replacing any object it maps to
+    void
+    assign(const K& key, const shared_ptr<T>& sp)
+    {
+        this->_sweep();
+        this->_entries[key] = sp;
+    }
+
+    /// Removes the entry of key, true if there was one
+    bool
+    erase(const K& key)
+    {
+        this->_sweep();
+        auto _it = this->_entries.find(key);
+        if (_it == this->_entries.end()) return false;
+        this->_erase(_it);
+        return true;
+    }
+
+    // Observers
+
+    /// Gets the object key maps to, or an empty shared_ptr if there is
+    ///     none or it has expired; in the latter case the entry is erased
+    shared_ptr<T>
+    find(const K& key)
+    {
+        this->_sweep();
+        auto _it = this->_entries.find(key);
+        if (_it == this->_entries.end()) return shared_ptr<T>{};
+        auto _sp = _it->second.lock();
+        if (!_sp) this->_erase(_it);
+        return _sp;
+    }
+
+    /// Calls f with each key and a shared_ptr to its live object, erasing
+    ///     the entries of the expired ones
+    template<typename F>
+    void
+    for_each(F f)
+    {
+        for (auto _it = this->_entries.begin(); _it != this->_entries.end(); ) {
+            if (auto _sp = _it->second.lock()) {
+                const K& _key = _it->first;
+                ++_it;
+                f(_key, _sp);
+            } else {
+                _it = this->_erase(_it);
+            }
+        }
+    }
+};
+
+} // namespace smart_ptr
+
+#endif
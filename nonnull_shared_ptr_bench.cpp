@@ -0,0 +1,101 @@
+// null tests saved by nonnull_shared_ptr
+
+/**
+ *  Copies, dereferences and destroys pointers to the same objects held as
+ *  shared_ptrs and as nonnull_shared_ptrs. A shared_ptr tests its control
+ *  block for null before each reference count update; a nonnull_shared_ptr
+ *  knows it has one. The copies go through a function the compiler may not
+ *  inline, so that it cannot prove the pointers non-null on its own.
+ *  Last, it times the checked conversion from an lvalue shared_ptr, which
+ *  takes a reference, against the one from an rvalue, which steals it.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include <utility>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::nonnull_shared_ptr;
+
+struct Node {
+    long value;
+};
+
+template<typename P>
+__attribute__((noinline)) long
+visit(P p)
+{ return p->value; }
+
+template<typename P>
+__attribute__((noinline)) void
+store(P& slot, const P& p)
+{ slot = p; }
+
+template<typename F>
+void time(const char* name, std::size_t ops, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    long sum = f();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-34s %8.2f ns/op   (%ld)\n", name, secs.count() * 1e9 / ops, sum);
+}
+
+template<typename P>
+void run(const char* copy_name, const char* assign_name, std::vector<P>& ptrs,
+         std::size_t rounds)
+{
+    time(copy_name, rounds * ptrs.size(), [&] {
+        long sum = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& p : ptrs) sum += visit<P>(p);
+        return sum;
+    });
+
+    time(assign_name, rounds * ptrs.size(), [&] {
+        P slot = ptrs.front();
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& p : ptrs) store(slot, p);
+        return slot->value;
+    });
+}
+
+int main()
+{
+    const std::size_t n = 1000, rounds = 20000;
+
+    std::vector<nonnull_shared_ptr<Node>> nonnull;
+    std::vector<shared_ptr<Node>> nullable;
+    for (std::size_t i = 0; i < n; ++i) {
+        nonnull.push_back(smart_ptr::make_nonnull_shared<Node>(Node{static_cast<long>(i)}));
+        nullable.push_back(nonnull.back());
+    }
+
+    run("shared_ptr copy + destroy", "shared_ptr assign", nullable, rounds);
+    run("nonnull_shared_ptr copy + destroy", "nonnull_shared_ptr assign", nonnull, rounds);
+
+    // the checked conversion steals the reference of an rvalue shared_ptr
+    time("nonnull from const shared_ptr&", rounds * n, [&] {
+        long sum = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& sp : nullable) {
+                shared_ptr<Node> tmp = sp;
+                nonnull_shared_ptr<Node> p{tmp};
+                sum += visit<nonnull_shared_ptr<Node>>(p);
+            }
+        return sum;
+    });
+
+    time("nonnull from shared_ptr&&", rounds * n, [&] {
+        long sum = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& sp : nullable) {
+                shared_ptr<Node> tmp = sp;
+                nonnull_shared_ptr<Node> p{std::move(tmp)};
+                sum += visit<nonnull_shared_ptr<Node>>(p);
+            }
+        return sum;
+    });
+}
@@ -0,0 +1,91 @@
+// demo of object_pool
+
+/**
+ *  Acquires buffers from an object_pool on one thread and on several at
+ *  once, returning some of them on other threads than the ones acquiring
+ *  them, and checks that released buffers are reset and reused, and that
+ *  every buffer created is destroyed exactly once.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::unique_ptr;
+using smart_ptr::object_pool;
+using smart_ptr::pool_deleter;
+
+struct Buffer {
+    Buffer() { ++created; }
+    ~Buffer() { ++destroyed; }
+
+    std::vector<char> bytes = std::vector<char>(4096);
+    std::size_t used = 0;
+
+    static std::atomic<int> created;
+    static std::atomic<int> destroyed;
+};
+
+std::atomic<int> Buffer::created{0};
+std::atomic<int> Buffer::destroyed{0};
+
+int main()
+{
+    std::cout << "===============object_pool demo===============" << std::endl;
+
+    std::cout << "\nReuse demo\n";
+    {
+        object_pool<Buffer> pool{16, [](Buffer& b) { b.used = 0; }};
+        Buffer* first;
+        {
+            auto up = pool.acquire();               // pool empty, created
+            first = up.get();
+            up->used = 100;
+        }                                           // reset and kept
+        auto up = pool.acquire();
+        assert(up.get() == first && up->used == 0); // the same buffer, reset
+        shared_ptr<Buffer> sp = pool.acquire_shared(); // up holds the first, created
+        Buffer* second = sp.get();
+        sp.reset();                                 // returned through shared_ptr
+        sp = pool.acquire_shared();
+        assert(sp.get() == second);
+        std::cout << "hits: " << pool.hits() << ", misses: " << pool.misses() << '\n';
+        assert(pool.hits() == 2 && pool.misses() == 2);
+    }
+    assert(Buffer::created == Buffer::destroyed);
+
+    std::cout << "\nReuse across threads demo\n";
+    {
+        const int threads = 4, rounds = 10000;
+        object_pool<Buffer> pool{64, [](Buffer& b) { b.used = 0; }};
+        std::vector<unique_ptr<Buffer, pool_deleter<Buffer>>> handoff[threads];
+        std::vector<std::thread> ts;
+        for (int t = 0; t < threads; ++t)
+            ts.emplace_back([&, t] {
+                for (int r = 0; r < rounds; ++r) {
+                    auto up = pool.acquire();
+                    assert(up->used == 0);
+                    up->used = 1;
+                    if (r % 100 == 0) handoff[t].push_back(std::move(up)); // returned by main
+                }
+            });
+        for (auto& t : ts) t.join();
+        for (auto& v : handoff) v.clear();          // released on another thread
+        auto up = pool.acquire();
+        assert(up->used == 0);
+        std::cout << "acquired: " << pool.hits() + pool.misses()
+                  << ", created: " << pool.misses() << '\n';
+        assert(pool.misses() < pool.hits());
+    }
+    // the buffers cached by the exited threads went back to the pool,
+    //     which destroyed them with itself
+    std::cout << "created: " << Buffer::created << ", destroyed: " << Buffer::destroyed << '\n';
+    assert(Buffer::created == Buffer::destroyed);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+// demo of weak_ptr::on_expire
+
+/**
+ *  Registers expiry callbacks on weak_ptrs, cancels one, and checks that
+ *  every other callback runs exactly once, after the object is destroyed,
+ *  also when registering races with the last shared_ptr going away on
+ *  another thread.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::expiry_token;
+
+struct Resource {
+    ~Resource() { destroyed = true; }
+
+    static bool destroyed;
+};
+
+bool Resource::destroyed = false;
+
+int main()
+{
+    std::cout << "===============on_expire demo===============" << std::endl;
+
+    std::cout << "\nCache eviction demo\n";
+    {
+        std::map<std::string, weak_ptr<Resource>> cache;
+        auto sp = make_shared<Resource>();
+        cache["a"] = sp;
+
+        int runs = 0;
+        auto token = cache["a"].on_expire([&] {
+            assert(Resource::destroyed); // called after the object is destroyed
+            cache.erase("a");
+            ++runs;
+        });
+        auto other = cache["a"].on_expire([&] { ++runs; });
+        auto cancelled = cache["a"].on_expire([&] { assert(false && "cancelled"); });
+        const bool removed = cancelled.cancel();
+        const bool removed_again = cancelled.cancel();
+        assert(removed && !removed_again);
+
+        sp.reset();
+        assert(runs == 2 && cache.empty());
+        const bool too_late = token.cancel();
+        assert(!too_late); // has run already
+        std::cout << "entry erased on expiry, callbacks run: " << runs << '\n';
+
+        // registering on an expired weak_ptr runs the callback at once
+        weak_ptr<Resource> expired = make_shared<Resource>();
+        bool ran = false;
+        expired.on_expire([&] { ran = true; });
+        assert(ran);
+    }
+
+    std::cout << "\nRegistration racing the last release demo\n";
+    {
+        const int rounds = 2000, callbacks = 4;
+        std::atomic<int> runs{0};
+        for (int r = 0; r < rounds; ++r) {
+            auto sp = make_shared<int>(r);
+            weak_ptr<int> wp = sp;
+            std::thread releaser([&] { sp.reset(); });
+            std::vector<expiry_token> tokens;
+            for (int c = 0; c < callbacks; ++c)
+                tokens.push_back(wp.on_expire([&] { runs.fetch_add(1); }));
+            releaser.join();
+        }
+        assert(runs.load() == rounds * callbacks);
+        std::cout << "callbacks run: " << runs.load() << " of "
+                  << rounds * callbacks << ", each exactly once\n";
+    }
+
+    return 0;
+}
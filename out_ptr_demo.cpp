@@ -0,0 +1,117 @@
+// demo of out_ptr, inout_ptr and unique_resource
+
+/**
+ *  Calls a C-style API that hands handles back through out-parameters,
+ *  with out_ptr and inout_ptr into unique_ptr and shared_ptr, and checks
+ *  that each smart pointer is reset with the handle written back, that the
+ *  handle it owned before is freed exactly once, and that a failed call
+ *  leaves it as it was. Then manages integer handles with unique_resource.
+ */
+
+#include <iostream>
+#include <cassert>
+
+#include "smart_ptr.hpp"
+using smart_ptr::unique_ptr;
+using smart_ptr::shared_ptr;
+using smart_ptr::out_ptr;
+using smart_ptr::inout_ptr;
+using smart_ptr::deleter_fn;
+using smart_ptr::unique_resource;
+using smart_ptr::make_unique_resource_checked;
+
+// A C library handing its handles back through out-parameters
+
+struct foo {
+    int generation;
+};
+
+static int foos_alive = 0;
+
+int foo_create(foo** out) { ++foos_alive; *out = new foo{0}; return 0; }
+int foo_create_void(void** out) { ++foos_alive; *out = new foo{0}; return 0; }
+int foo_fail(foo** out) { *out = nullptr; return -1; }
+void foo_destroy(foo* f) { --foos_alive; delete f; }
+
+/// Frees *inout and stores a new handle in its place
+int foo_reopen(foo** inout)
+{
+    const int g = (*inout) ? (*inout)->generation + 1 : 0;
+    if (*inout) foo_destroy(*inout);
+    ++foos_alive;
+    *inout = new foo{g};
+    return 0;
+}
+
+using foo_deleter = deleter_fn<decltype(&foo_destroy), &foo_destroy>;
+
+// Integer handles, -1 being invalid
+
+static int handles_open = 0;
+
+int handle_open(bool ok) { if (!ok) return -1; ++handles_open; return 3; }
+void handle_close(int) { --handles_open; }
+
+using handle_closer = deleter_fn<decltype(&handle_close), &handle_close>;
+
+int main()
+{
+    std::cout << "===============out_ptr demo===============" << std::endl;
+
+    std::cout << "\nout_ptr into unique_ptr demo\n";
+    {
+        unique_ptr<foo, foo_deleter> up;
+        foo_create(out_ptr(up));                    // reset at the end of the statement
+        assert(up && foos_alive == 1);
+
+        foo* first = up.get();
+        foo_create(out_ptr(up));                    // the first handle is freed
+        assert(up.get() != first && foos_alive == 1);
+
+        foo* second = up.get();
+        const int err = foo_fail(out_ptr(up));      // nothing written back, up kept
+        assert(err == -1 && up.get() == second && foos_alive == 1);
+
+        foo_create_void(out_ptr<void*>(up));        // through void**
+        assert(up && foos_alive == 1);
+        std::cout << "handles alive: " << foos_alive << '\n';
+    }
+    assert(foos_alive == 0);
+
+    std::cout << "\nout_ptr into shared_ptr demo\n";
+    {
+        shared_ptr<foo> sp;
+        foo_create(out_ptr(sp, foo_deleter{}));     // shared_ptr needs its deleter
+        shared_ptr<foo> copy = sp;
+        assert(sp && sp.use_count() == 2 && foos_alive == 1);
+    }
+    assert(foos_alive == 0);
+
+    std::cout << "\ninout_ptr demo\n";
+    {
+        unique_ptr<foo, foo_deleter> up;
+        foo_create(out_ptr(up));
+        for (int i = 0; i < 3; ++i)
+            foo_reopen(inout_ptr(up));              // frees the handle passed in
+        assert(up->generation == 3 && foos_alive == 1);
+        std::cout << "generation after 3 reopens: " << up->generation << '\n';
+    }
+    assert(foos_alive == 0);
+
+    std::cout << "\nunique_resource demo\n";
+    {
+        auto h = make_unique_resource_checked(handle_open(true), -1, handle_closer{});
+        auto bad = make_unique_resource_checked(handle_open(false), -1, handle_closer{});
+        assert(h.get() == 3 && handles_open == 1);
+
+        auto moved = std::move(h);                  // closed once, by moved
+        h.reset();
+        assert(handles_open == 1);
+        moved.reset(handle_open(true));             // closes the old one first
+        assert(handles_open == 1);
+        std::cout << "sizeof(unique_resource<int, handle_closer>) = " << sizeof(moved) << '\n';
+    } // bad, invalid, is not closed
+    assert(handles_open == 0);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+// demo of ownership_arena
+
+/**
+ *  Creates the objects of a request from an ownership_arena, drops them
+ *  one by one, and lets one shared_ptr escape the arena: its chunk is kept,
+ *  so the object stays valid, and the escape handler is told about it.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::ownership_arena;
+
+struct Node {
+    explicit Node(int i) : id{i} { ++live; }
+    ~Node() { --live; }
+
+    int id;
+    std::string name = "node";
+
+    static int live;
+};
+
+int Node::live = 0;
+
+static std::size_t escaped_reported = 0;
+
+void count_escapes(std::size_t escaped) { escaped_reported = escaped; }
+
+int main()
+{
+    std::cout << "===============ownership_arena demo===============" << std::endl;
+
+    std::cout << "\nPer-request arena demo\n";
+    {
+        ownership_arena arena;
+        std::vector<shared_ptr<Node>> nodes;
+        for (int i = 0; i < 1000; ++i) nodes.push_back(arena.make_shared<Node>(i));
+        std::cout << "objects: " << arena.size() << ", live: " << Node::live << '\n';
+
+        weak_ptr<Node> wp = nodes[7];
+        nodes[7].reset(); // destroyed at once, its memory stays in the arena
+        assert(wp.expired() && Node::live == 999);
+        std::cout << "escaped while in use: " << arena.escaped() << '\n'; // 1000, incl. wp
+
+        nodes.clear();
+        wp.reset();
+        assert(Node::live == 0 && arena.escaped() == 0);
+    } // all chunks freed at once
+
+    std::cout << "\nEscaped shared_ptr demo\n";
+    {
+        shared_ptr<Node> escapee;
+        {
+            ownership_arena arena{&count_escapes};
+            for (int i = 0; i < 100; ++i) arena.make_shared<Node>(i);
+            escapee = arena.make_shared<Node>(42);
+        } // escapee's chunk is kept, the handler is called
+        assert(escaped_reported == 1);
+        assert(escapee->id == 42 && escapee->name == "node"); // still valid
+        std::cout << "escaped: " << escaped_reported << ", id still " << escapee->id << '\n';
+    }
+    assert(Node::live == 0);
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+// push_back growth with uninitialized_relocate
+
+/**
+ *  Pushes 100M unique_ptrs into a growing buffer that doubles its capacity
+ *  when full, once relocating the elements with uninitialized_relocate (a
+ *  memcpy, unique_ptr being trivially relocatable) and once moving them
+ *  one by one as std::vector does, then with std::vector itself. Page
+ *  faults on each new buffer otherwise dominate, so the two buffers fault
+ *  their pages in ahead of relocating and leave that out of their times;
+ *  std::vector's time includes them. The time spent relocating on growth
+ *  alone is reported last. The count may be given as the first argument.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <chrono>
+#include <type_traits>
+
+#include "smart_ptr.hpp"
+using smart_ptr::unique_ptr;
+
+/// Stateless deleter, so that the pointers need not own heap objects
+struct no_delete {
+    void operator()(int*) const noexcept { }
+};
+
+using ptr = unique_ptr<int, no_delete>;
+static_assert(smart_ptr::is_trivially_relocatable<ptr>::value, "ptr should be relocatable");
+
+/// Time spent faulting pages in ahead of relocations, left out of totals
+static double untimed_secs = 0;
+
+/// Growth buffer relocating its elements with memcpy when Memcpy is true,
+///     with a move and a destructor call per element otherwise
+template<bool Memcpy>
+class growth_buffer {
+public:
+    growth_buffer() = default;
+    growth_buffer(const growth_buffer&) = delete;
+    growth_buffer& operator=(const growth_buffer&) = delete;
+
+    ~growth_buffer()
+    {
+        for (ptr* p = _begin; p != _end; ++p) p->~ptr();
+        ::operator delete(_begin);
+    }
+
+    void
+    push_back(ptr&& p)
+    {
+        if (_end == _cap) _grow();
+        ::new (static_cast<void*>(_end)) ptr(std::move(p));
+        ++_end;
+    }
+
+    std::size_t
+    size() const noexcept
+    { return _end - _begin; }
+
+    /// Time spent relocating, and number of elements relocated
+    static double relocate_secs;
+    static std::size_t relocated;
+
+private:
+    void
+    _grow()
+    {
+        const std::size_t n = size(), cap = n ? 2 * n : 16;
+        ptr* b = static_cast<ptr*>(::operator new(cap * sizeof(ptr)));
+        auto fault = std::chrono::steady_clock::now();
+        std::memset(static_cast<void*>(b), 0, n * sizeof(ptr)); // fault the pages in
+        auto start = std::chrono::steady_clock::now();
+        untimed_secs += std::chrono::duration<double>(start - fault).count();
+        ptr* e = smart_ptr::detail::uninitialized_relocate(_begin, _end, b,
+                     std::integral_constant<bool, Memcpy>{});
+        relocate_secs += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        relocated += n;
+        ::operator delete(_begin);
+        _begin = b;
+        _end = e;
+        _cap = b + cap;
+    }
+
+    ptr* _begin = nullptr;
+    ptr* _end = nullptr;
+    ptr* _cap = nullptr;
+};
+
+template<bool Memcpy>
+double growth_buffer<Memcpy>::relocate_secs = 0;
+
+template<bool Memcpy>
+std::size_t growth_buffer<Memcpy>::relocated = 0;
+
+static int targets[64];
+
+template<typename V>
+void time(const char* name, std::size_t n)
+{
+    const double untimed = untimed_secs;
+    auto start = std::chrono::steady_clock::now();
+    {
+        V v;
+        for (std::size_t i = 0; i < n; ++i) v.push_back(ptr{&targets[i % 64]});
+        if (v.size() != n) std::abort();
+    }
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    secs -= std::chrono::duration<double>(untimed_secs - untimed);
+    std::printf("%-28s %8.2f ns/push_back  (%.2f s)\n", name,
+                secs.count() * 1e9 / n, secs.count());
+}
+
+template<bool Memcpy>
+void report_relocation(const char* name)
+{
+    using B = growth_buffer<Memcpy>;
+    std::printf("%-28s %8.2f ns/element relocated  (%.2f s)\n", name,
+                B::relocate_secs * 1e9 / B::relocated, B::relocate_secs);
+}
+
+int main(int argc, char** argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000000;
+
+    for (int round = 0; round < 2; ++round) {
+        time<growth_buffer<true>>("uninitialized_relocate", n);
+        time<growth_buffer<false>>("element-wise move", n);
+        time<std::vector<ptr>>("std::vector", n);
+    }
+    std::printf("growth only:\n");
+    report_relocation<true>("uninitialized_relocate");
+    report_relocation<false>("element-wise move");
+}
@@ -0,0 +1,91 @@
+// producer to consumer throughput of make_shared_remote_free
+
+/**
+ *  A producer thread creates messages and hands them to a consumer thread
+ *  through a single-producer single-consumer ring, and the consumer drops
+ *  them, so that every message is freed on a thread other than the one
+ *  that allocated it. Run once with make_shared and once with
+ *  make_shared_remote_free.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+
+struct Msg {
+    explicit Msg(long i) : id{i} { }
+    long id;
+    char payload[48];
+};
+
+/// Single-producer single-consumer ring of shared_ptrs
+class Ring {
+public:
+    bool push(shared_ptr<Msg>& m)
+    {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == size) return false;
+        slots[t % size] = std::move(m);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(shared_ptr<Msg>& m)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        m = std::move(slots[h % size]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr std::size_t size = 1024;
+    shared_ptr<Msg> slots[size];
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+template<typename Make>
+void run(const char* name, Make make, long count)
+{
+    Ring ring;
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer{[&] {
+        for (long i = 0; i < count; ++i) {
+            auto m = make(i);
+            while (!ring.push(m)) std::this_thread::yield();
+        }
+    }};
+    std::thread consumer{[&] {
+        shared_ptr<Msg> m;
+        for (long i = 0; i < count; ) {
+            if (ring.pop(m)) { m.reset(); ++i; }
+            else std::this_thread::yield();
+        }
+    }};
+    producer.join();
+    consumer.join();
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-24s %8.2f M msgs/s\n", name, count / secs.count() / 1e6);
+}
+
+int main()
+{
+    const long count = 5000000;
+    for (int round = 0; round < 2; ++round) {
+        run("make_shared", [](long i) {
+            return smart_ptr::make_shared<Msg>(i);
+        }, count);
+        run("make_shared_remote_free", [](long i) {
+            return smart_ptr::make_shared_remote_free<Msg>(i);
+        }, count);
+    }
+}
@@ -0,0 +1,86 @@
+// demo of retain_ptr
+
+/**
+ *  Wraps a C-style reference counted handle, with foo_create, foo_ref and
+ *  foo_unref, in retain_ptr, once through the default traits found by
+ *  argument-dependent lookup and once through a traits class, and checks
+ *  the object's own count as retain_ptrs are copied, moved and released.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "smart_ptr.hpp"
+using smart_ptr::retain_ptr;
+using smart_ptr::adopt_object;
+using smart_ptr::retain_object;
+
+// A C library's handle: created with one reference held by the caller
+
+struct foo {
+    int refs;
+    int value;
+};
+
+static int foos_alive = 0;
+
+foo* foo_create(int value) { ++foos_alive; return new foo{1, value}; }
+void foo_ref(foo* f) { ++f->refs; }
+void foo_unref(foo* f) { if (--f->refs == 0) { --foos_alive; delete f; } }
+
+// Default traits: found by argument-dependent lookup
+void retain_ptr_add_ref(foo* f) noexcept { foo_ref(f); }
+void retain_ptr_release(foo* f) noexcept { foo_unref(f); }
+
+// Traits class naming the library's functions
+struct foo_traits {
+    static void increment(foo* f) noexcept { foo_ref(f); }
+    static void decrement(foo* f) noexcept { foo_unref(f); }
+};
+
+int main()
+{
+    std::cout << "===============retain_ptr demo===============" << std::endl;
+
+    std::cout << "\nIntrusive reference count demo\n";
+    {
+        retain_ptr<foo> p{foo_create(7), adopt_object}; // no extra reference
+        assert(p->refs == 1);
+        {
+            auto q = p;                                 // foo_ref
+            assert(p->refs == 2 && q == p);
+            std::vector<retain_ptr<foo>> v;
+            v.push_back(std::move(q));                  // moved, no foo_ref
+            assert(!q && p->refs == 2);
+        }                                               // foo_unref
+        assert(p->refs == 1);
+
+        foo* raw = foo_create(8);
+        retain_ptr<foo> r{raw, retain_object};          // takes a second reference
+        assert(raw->refs == 2);
+        foo_unref(raw);                                 // the caller's own
+        std::cout << "sizeof(retain_ptr<foo>) = " << sizeof(r) << '\n'; // one pointer
+        assert(sizeof(r) == sizeof(foo*));
+
+        foo* released = p.release();                    // handed back, count kept
+        assert(!p && released->refs == 1);
+        foo_unref(released);
+    }
+    assert(foos_alive == 0);
+
+    std::cout << "\nTraits class demo\n";
+    {
+        retain_ptr<foo, foo_traits> p{foo_create(9), adopt_object};
+        retain_ptr<foo, foo_traits> q;
+        q = p;
+        assert(q->refs == 2);
+        p.reset();
+        assert(q->refs == 1 && q->value == 9);
+        std::cout << "value " << q->value << ", refs " << q->refs << '\n';
+    }
+    assert(foos_alive == 0);
+
+    return 0;
+}
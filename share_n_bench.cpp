@@ -0,0 +1,56 @@
+// pub/sub fan-out with share_n and release_n
+
+/**
+ *  A publisher broadcasts each message to every subscriber queue, and the
+ *  subscribers then drop what they received. Copying the shared_ptr once
+ *  per queue costs one atomic increment (and later decrement) per
+ *  subscriber, all on the same cache line; share_n and release_n take and
+ *  drop all of them with a single atomic operation.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+
+struct Msg {
+    long id;
+    char payload[56];
+};
+
+template<typename F>
+void time(const char* name, std::size_t subscribers, long messages, F f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-22s %4zu subscribers %8.2f ns/delivery\n", name, subscribers,
+                secs.count() * 1e9 / (messages * subscribers));
+}
+
+int main()
+{
+    const long messages = 200000;
+    for (std::size_t subscribers : {4, 16, 64, 256}) {
+        std::vector<shared_ptr<const Msg>> inbox(subscribers);
+
+        time("copy per subscriber", subscribers, messages, [&] {
+            for (long i = 0; i < messages; ++i) {
+                shared_ptr<const Msg> m = smart_ptr::make_shared<Msg>(Msg{i, {}});
+                for (auto& slot : inbox) slot = m;
+                for (auto& slot : inbox) slot.reset();
+            }
+        });
+
+        time("share_n / release_n", subscribers, messages, [&] {
+            for (long i = 0; i < messages; ++i) {
+                shared_ptr<const Msg> m = smart_ptr::make_shared<Msg>(Msg{i, {}});
+                smart_ptr::share_n(m, subscribers, inbox.begin());
+                smart_ptr::release_n(inbox.begin(), subscribers);
+            }
+        });
+    }
+}
@@ -21,6 +21,7 @@
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <stdexcept>
 
 // using std::unique_ptr;
 // using std::shared_ptr;
@@ -70,6 +71,22 @@ struct Derived: public Base
     ~Derived() { std::cout << "  Derived::~Derived()\n"; }
 };
 
+/// Output iterator appending to a vector that throws after limit elements
+template<typename T>
+struct ThrowingInserter {
+    std::vector<T>& v;
+    std::size_t limit;
+
+    ThrowingInserter& operator*() { return *this; }
+    ThrowingInserter& operator++() { return *this; }
+    ThrowingInserter& operator=(T x)
+    {
+        if (v.size() == limit) throw std::runtime_error{"output full"};
+        v.push_back(std::move(x));
+        return *this;
+    }
+};
+
 void thr(shared_ptr<Base> p)
 {
     std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -192,12 +209,31 @@ int main()
         printf("%d %d\n", p0.owner_before(p1), p1.owner_before(p0));  // 0 0
     }
 
+    std::cout << "\nshare_n with a throwing output iterator demo\n";
+    {
+        auto sp = make_shared<int>(42);
+        std::vector<shared_ptr<int>> v;
+        ThrowingInserter<shared_ptr<int>> out{v, 3}; // throws on the 4th copy
+        try {
+            smart_ptr::share_n(sp, 8, out);
+        } catch (const std::runtime_error& e) {
+            std::cout << "caught: " << e.what() << '\n';
+        }
+        assert(v.size() == 3);
+        assert(sp.use_count() == 4); // sp and the 3 copies written, nothing leaked
+        v.clear();
+        assert(sp.use_count() == 1);
+        std::cout << "use_count after the copies are dropped: " << sp.use_count() << '\n';
+    }
+
     std::cout << "\nGet deleter demo\n";
     {
-        auto sp = make_shared<D>();
+        shared_ptr<D> sp(new D, default_delete<D>());
         D* p = new D;
         auto del_p = get_deleter<default_delete<D>>(sp);
         (*del_p)(p);
+        // make_shared keeps a small object in its control block, no deleter
+        assert(!get_deleter<default_delete<D>>(make_shared<D>()));
     }
 
     return 0;
@@ -0,0 +1,88 @@
+// iteration and lookup through slot_map handles and weak_ptrs
+
+/**
+ *  Creates the same entities once in a slot_map and once as shared_ptrs,
+ *  then times iterating over all of them, and looking them up at random
+ *  through handles and through weak_ptr::lock.
+ */
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::weak_ptr;
+using smart_ptr::slot_map;
+using smart_ptr::handle;
+
+struct Entity {
+    explicit Entity(long i) : x{i}, y{2 * i} { }
+    long x;
+    long y;
+};
+
+template<typename F>
+void time(const char* name, F f, std::size_t ops)
+{
+    auto start = std::chrono::steady_clock::now();
+    long sum = f();
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    std::printf("%-24s %8.2f ns/op   (%ld)\n", name, secs.count() * 1e9 / ops, sum);
+}
+
+int main()
+{
+    const std::size_t n = 1000000, lookups = 10000000, rounds = 20;
+
+    // ownership of the slot map itself through the library's unique_ptr
+    auto entities = smart_ptr::make_unique<slot_map<Entity>>();
+    std::vector<handle<Entity>> handles;
+    std::vector<shared_ptr<Entity>> owners;
+    std::vector<weak_ptr<Entity>> weaks;
+    for (std::size_t i = 0; i < n; ++i) {
+        handles.push_back(entities->insert(static_cast<long>(i)));
+        owners.push_back(smart_ptr::make_shared<Entity>(static_cast<long>(i)));
+        weaks.push_back(owners.back());
+    }
+    // erase every tenth entity in both
+    for (std::size_t i = 0; i < n; i += 10) {
+        entities->erase(handles[i]);
+        owners[i].reset();
+    }
+
+    std::vector<std::size_t> order(lookups);
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<std::size_t> dist{0, n - 1};
+    for (auto& i : order) i = dist(gen);
+
+    time("slot_map iterate", [&] {
+        long sum = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& e : *entities) sum += e.x;
+        return sum;
+    }, rounds * entities->size());
+
+    time("shared_ptr iterate", [&] {
+        long sum = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+            for (auto& sp : owners) if (sp) sum += sp->x;
+        return sum;
+    }, rounds * entities->size());
+
+    time("handle lookup", [&] {
+        long sum = 0;
+        for (auto i : order)
+            if (auto e = entities->get(handles[i])) sum += e->y;
+        return sum;
+    }, lookups);
+
+    time("weak_ptr lock", [&] {
+        long sum = 0;
+        for (auto i : order)
+            if (auto sp = weaks[i].lock()) sum += sp->y;
+        return sum;
+    }, lookups);
+}
@@ -0,0 +1,66 @@
+// demo of slot_map
+
+/**
+ *  Inserts entities into a slot_map, erases some, and checks that the
+ *  handles to them go stale, even once their slots are reused, while the
+ *  handles to the others keep finding their entities after those moved.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "smart_ptr.hpp"
+using smart_ptr::slot_map;
+using smart_ptr::handle;
+
+struct Entity {
+    std::string name;
+    int hp;
+};
+
+int main()
+{
+    std::cout << "===============slot_map demo===============" << std::endl;
+
+    std::cout << "\nStale handle demo\n";
+    {
+        slot_map<Entity> entities;
+        std::vector<handle<Entity>> hs;
+        for (int i = 0; i < 5; ++i)
+            hs.push_back(entities.insert(Entity{"e" + std::to_string(i), 10 * i}));
+
+        const bool erased = entities.erase(hs[1]);
+        const bool erased_again = entities.erase(hs[1]);
+        assert(erased && !erased_again);        // already gone
+        assert(!entities.contains(hs[1]) && !entities.get(hs[1]));
+
+        // e4 was moved into e1's place, its handle still finds it
+        assert(entities.get(hs[4])->name == "e4");
+        assert(entities.handle_of(entities[hs[4]]) == hs[4]);
+
+        // the freed slot is reused, with a new generation
+        auto h5 = entities.insert(Entity{"e5", 50});
+        assert(h5.index == hs[1].index && h5 != hs[1]);
+        assert(!entities.get(hs[1]) && entities.get(h5)->name == "e5");
+        std::cout << "stale handle rejected after its slot was reused\n";
+
+        for (auto& e : entities) std::cout << e.name << ' ' << e.hp << '\n';
+
+        entities.clear();
+        for (auto h : hs) assert(!entities.contains(h));
+        assert(!entities.contains(h5) && entities.empty());
+    }
+
+    std::cout << "\nHandles across a move demo\n";
+    {
+        slot_map<Entity> a;
+        auto h = a.insert(Entity{"hero", 100});
+        slot_map<Entity> b = std::move(a);
+        assert(b.get(h) && b[h].hp == 100);
+        std::cout << b[h].name << " found in the moved-to slot_map\n";
+    }
+
+    return 0;
+}
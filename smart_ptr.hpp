@@ -10,5 +10,22 @@
 #include "include/default_delete.hpp"
 #include "include/bad_weak_ptr.hpp"
 #include "include/owner_less.hpp"
+#include "include/relocate.hpp"
+#include "include/retain_ptr.hpp"
+#include "include/out_ptr.hpp"
+#include "include/unique_resource.hpp"
+#include "include/borrowed_ptr.hpp"
+#include "include/nonnull_shared_ptr.hpp"
+#include "include/aligned.hpp"
+#include "include/huge_page.hpp"
+#include "include/arena.hpp"
+#include "include/numa.hpp"
+#include "include/pmr.hpp"
+#include "include/ownership_arena.hpp"
+#include "include/object_pool.hpp"
+#include "include/remote_free.hpp"
+#include "include/slot_map.hpp"
+#include "include/weak_set.hpp"
+#include "include/atomic_weak_slot.hpp"
 
 #endif
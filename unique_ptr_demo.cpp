@@ -21,6 +21,7 @@
 using smart_ptr::default_delete;
 using smart_ptr::unique_ptr;
 using smart_ptr::make_unique;
+using smart_ptr::deleter_fn;
 
 void close_file(std::FILE* fp) { std::fclose(fp); }
 
@@ -99,12 +100,15 @@ int main()
         std::ofstream("demo.txt") << 'x'; // prepare the file to read
         auto up5 = unique_ptr<std::FILE, decltype(&close_file)>
             {std::fopen("demo.txt", "r"), &close_file};
+        auto up6 = unique_ptr<std::FILE, deleter_fn<decltype(&close_file), &close_file>>
+            {std::fopen("demo.txt", "r")};
 
         std::cout << sizeof(up1) << std::endl; // 8
         std::cout << sizeof(up2) << std::endl; // still 8 by EBO
         std::cout << sizeof(up3) << std::endl; // still 8 by EBO
         std::cout << sizeof(up4) << std::endl; // 40, std::function takes 32 bytes
         std::cout << sizeof(up5) << std::endl; // 16, additional function pointer
+        std::cout << sizeof(up6) << std::endl; // still 8, function named by deleter_fn's type
     }
 
     return 0;
@@ -0,0 +1,86 @@
+// demo of weak_set and weak_value_map
+
+/**
+ *  Keeps observers in a weak_set and values in a weak_value_map, lets most
+ *  of their objects expire, and checks that the expired entries are pruned:
+ *  bit by bit by later operations, all at once by compact(), and on the
+ *  way by for_each and find.
+ */
+
+#include <iostream>
+#include <cassert>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "smart_ptr.hpp"
+using smart_ptr::shared_ptr;
+using smart_ptr::make_shared;
+using smart_ptr::weak_set;
+using smart_ptr::weak_value_map;
+
+struct Observer {
+    explicit Observer(int i) : id{i} { }
+
+    int id;
+    int notified = 0;
+};
+
+int main()
+{
+    std::cout << "===============weak_set demo===============" << std::endl;
+
+    std::cout << "\nIncremental pruning demo\n";
+    {
+        weak_set<Observer> observers;
+        std::vector<shared_ptr<Observer>> live;
+        for (int i = 0; i < 100; ++i) {
+            auto sp = make_shared<Observer>(i);
+            observers.insert(sp);
+            if (i % 10 == 0) live.push_back(sp);   // 10 survive
+        }
+        const bool again = observers.insert(live[0]);
+        assert(!again);                            // same owner, not added twice
+
+        // every operation checks a few entries after a cursor, so the
+        //     inserts have erased most expired entries already
+        const std::size_t left = observers.size();
+        assert(left < 100);
+        const std::size_t erased = observers.compact(); // erases the others
+        assert(erased == left - 10);
+        assert(observers.size() == 10);
+        std::cout << "entries after 100 inserts: " << left
+                  << ", after compact: " << observers.size() << '\n';
+
+        live.resize(5);
+        std::size_t visited = 0;
+        observers.for_each([&](const shared_ptr<Observer>& o) { ++o->notified; ++visited; });
+        assert(visited == 5 && observers.size() == 5); // for_each erased the rest
+        for (auto& sp : live) assert(sp->notified == 1);
+        std::cout << "notified " << visited << ", entries left: " << observers.size() << '\n';
+    }
+
+    std::cout << "\nweak_value_map demo\n";
+    {
+        weak_value_map<std::string, Observer> by_name;
+        auto a = make_shared<Observer>(1);
+        by_name.insert("a", a);
+        by_name.insert("b", make_shared<Observer>(2)); // expires at once
+
+        auto found_a = by_name.find("a");
+        auto found_b = by_name.find("b");          // expired, erased by find
+        assert(found_a == a && !found_b);
+        assert(by_name.size() == 1);
+
+        auto b = make_shared<Observer>(3);
+        const bool free_again = by_name.insert("b", b);
+        const bool replaced = by_name.insert("b", a);
+        assert(free_again && !replaced);           // b maps to a live object
+        by_name.assign("b", a);
+        found_b = by_name.find("b");
+        assert(found_b == a);
+        std::cout << "entries: " << by_name.size() << '\n';
+    }
+
+    return 0;
+}